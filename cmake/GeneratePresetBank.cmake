@@ -0,0 +1,91 @@
+#    Copyright 2025 David Whiting
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+# Turns resources/presets.xml into a header of constexpr tables, so the plugin doesn't have to parse anything at
+# runtime. Run in script mode:
+#     cmake -DINPUT=<presets.xml> -DOUTPUT=<CryptPresetBank.h> -P GeneratePresetBank.cmake
+
+if (NOT INPUT OR NOT OUTPUT)
+    message(FATAL_ERROR "GeneratePresetBank needs INPUT and OUTPUT")
+endif()
+
+file(READ "${INPUT}" xml)
+
+# Whatever would be awkward inside a C string literal, after undoing the XML escapes
+function(to_c_string text result)
+    string(REPLACE "&lt;" "<" text "${text}")
+    string(REPLACE "&gt;" ">" text "${text}")
+    string(REPLACE "&quot;" "\"" text "${text}")
+    string(REPLACE "&apos;" "'" text "${text}")
+    string(REPLACE "&amp;" "&" text "${text}")
+    string(STRIP "${text}" text)
+    string(REPLACE "\\" "\\\\" text "${text}")
+    string(REPLACE "\"" "\\\"" text "${text}")
+    set(${result} "\"${text}\"" PARENT_SCOPE)
+endfunction()
+
+# CMake regexes can't be lazy, so split on the closing tags instead of matching whole presets (which means turning
+# any semicolons into something that doesn't split a CMake list first)
+string(REPLACE ";" "," xml "${xml}")
+string(REPLACE "</preset>" ";" chunks "${xml}")
+
+set(tables "")
+set(entries "")
+set(count 0)
+
+foreach(chunk IN LISTS chunks)
+    if (NOT chunk MATCHES "<name>([^<]*)</name>")
+        continue()
+    endif()
+    to_c_string("${CMAKE_MATCH_1}" name)
+
+    string(REGEX MATCHALL "<PARAM id=\"[^\"]*\" value=\"[^\"]*\"" params "${chunk}")
+    set(values "")
+    set(numValues 0)
+    foreach(param IN LISTS params)
+        string(REGEX MATCH "id=\"([^\"]*)\" value=\"([^\"]*)\"" unused "${param}")
+        set(id "${CMAKE_MATCH_1}")
+        set(value "${CMAKE_MATCH_2}")
+        if (NOT value MATCHES "^-?[0-9]+(\\.[0-9]*)?([eE][-+]?[0-9]+)?$")
+            message(FATAL_ERROR "Preset ${name}: ${id} has a value which isn't a number: ${value}")
+        endif()
+        to_c_string("${id}" id)
+        string(APPEND values "        { ${id}, ${value} },\n")
+        math(EXPR numValues "${numValues} + 1")
+    endforeach()
+
+    string(APPEND tables "    inline constexpr PresetValue preset${count}[] = {\n${values}    };\n\n")
+    string(APPEND entries "        { ${name}, preset${count}, ${numValues} },\n")
+    math(EXPR count "${count} + 1")
+endforeach()
+
+if (count EQUAL 0)
+    message(FATAL_ERROR "No presets found in ${INPUT}")
+endif()
+
+set(content "// Generated from presets.xml by GeneratePresetBank.cmake, don't edit\n")
+string(APPEND content "#pragma once\n\n")
+string(APPEND content "namespace CryptPresetBank {\n")
+string(APPEND content "    struct PresetValue {\n        const char* id;\n        float value;\n    };\n\n")
+string(APPEND content "    struct PresetEntry {\n        const char* name;\n        const PresetValue* values;\n        int numValues;\n    };\n\n")
+string(APPEND content "${tables}")
+string(APPEND content "    inline constexpr PresetEntry presets[] = {\n${entries}    };\n\n")
+string(APPEND content "    inline constexpr int numPresets = ${count};\n")
+string(APPEND content "}\n")
+
+# Only touch the output if it changed, so a rebuild doesn't recompile the plugin for nothing
+file(WRITE "${OUTPUT}.tmp" "${content}")
+execute_process(COMMAND "${CMAKE_COMMAND}" -E copy_if_different "${OUTPUT}.tmp" "${OUTPUT}")
+file(REMOVE "${OUTPUT}.tmp")
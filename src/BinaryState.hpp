@@ -0,0 +1,138 @@
+/*
+    Copyright 2025 David Whiting
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <JuceHeader.h>
+
+/** The plugin state as the host stores it, without going through XML. Hosts ask for it on every undo point and
+ *  autosave, and restoring it only touches the parameters that have actually changed, rather than rebuilding the
+ *  whole tree and waking up every listener in every voice.
+ *
+ *  Layout (little-endian):
+ *      int32 MAGIC, int32 VERSION
+ *      int32 parameter count, then per parameter: uint16 index, int32 hash of the ID, float value
+ *      int32 property count, then per property: name and value as null-terminated UTF-8
+ *
+ *  The index is the fast path; the ID hash catches parameters that have moved since the state was saved. Values are
+ *  stored unnormalised so that they survive a change of range. The properties are those of the root of the state tree
+ *  which aren't parameters, like the impulse response path.
+ */
+namespace BinaryState {
+    /** "CRPT" when read as bytes. Anything else is assumed to be the old XML format */
+    constexpr int MAGIC = 0x54505243;
+    constexpr int VERSION = 1;
+
+    inline bool isBinaryState(const void* data, int sizeInBytes) {
+        return sizeInBytes >= 8 && ByteOrder::littleEndianInt(data) == (uint32) MAGIC;
+    }
+
+    inline void write(AudioProcessorValueTreeState& state, MemoryBlock& dest) {
+        auto& parameters = state.processor.getParameters();
+
+        MemoryOutputStream out(dest, false);
+        out.writeInt(MAGIC);
+        out.writeInt(VERSION);
+
+        out.writeInt(parameters.size());
+        for (auto* parameter: parameters) {
+            auto* ranged = dynamic_cast<RangedAudioParameter*>(parameter);
+            jassert(ranged != nullptr);
+            out.writeShort((short) parameter->getParameterIndex());
+            out.writeInt(ranged->paramID.hashCode());
+            out.writeFloat(ranged->convertFrom0to1(ranged->getValue()));
+        }
+
+        auto& tree = state.state;
+        out.writeInt(tree.getNumProperties());
+        for (int i = 0; i < tree.getNumProperties(); i++) {
+            auto name = tree.getPropertyName(i);
+            out.writeString(name.toString());
+            out.writeString(tree.getProperty(name).toString());
+        }
+    }
+
+    /** Applies a state written by write(), returns false without changing anything if it can't be read. Parameters the
+     *  state doesn't mention are left as they are, like ValueTree-based restoring does */
+    inline bool read(AudioProcessorValueTreeState& state, const void* data, int sizeInBytes) {
+        if (! isBinaryState(data, sizeInBytes)) {
+            return false;
+        }
+
+        MemoryInputStream in(data, (size_t) sizeInBytes, false);
+        in.readInt();
+        if (in.readInt() > VERSION) {
+            return false;
+        }
+
+        auto& parameters = state.processor.getParameters();
+        auto findParameter = [&parameters] (int index, int hash) -> RangedAudioParameter* {
+            auto matches = [hash] (AudioProcessorParameter* p) {
+                auto* ranged = dynamic_cast<RangedAudioParameter*>(p);
+                return ranged != nullptr && ranged->paramID.hashCode() == hash;
+            };
+            if (isPositiveAndBelow(index, parameters.size()) && matches(parameters[index])) {
+                return dynamic_cast<RangedAudioParameter*>(parameters[index]);
+            }
+            for (auto* p: parameters) {
+                if (matches(p)) {
+                    return dynamic_cast<RangedAudioParameter*>(p);
+                }
+            }
+            return nullptr;
+        };
+
+        auto numParameters = in.readInt();
+        // Each entry is 10 bytes, so this catches a truncated state before any of it gets applied
+        if (numParameters < 0 || in.getNumBytesRemaining() < (int64) numParameters * 10) {
+            return false;
+        }
+
+        for (int i = 0; i < numParameters; i++) {
+            auto index = (int) (uint16) in.readShort();
+            auto hash = in.readInt();
+            auto value = in.readFloat();
+
+            if (auto* parameter = findParameter(index, hash)) {
+                auto normalised = parameter->convertTo0to1(value);
+                if (normalised != parameter->getValue()) {
+                    parameter->setValueNotifyingHost(normalised);
+                }
+            }
+        }
+
+        // Setting a property to the value it already has doesn't notify anyone, so these are diffed for free
+        auto& tree = state.state;
+        auto numProperties = in.readInt();
+        NamedValueSet restored;
+        for (int i = 0; i < numProperties && ! in.isExhausted(); i++) {
+            auto name = in.readString();
+            auto value = in.readString();
+            if (name.isNotEmpty()) {
+                restored.set(Identifier(name), value);
+            }
+        }
+        for (int i = tree.getNumProperties(); --i >= 0;) {
+            auto name = tree.getPropertyName(i);
+            if (! restored.contains(name)) {
+                tree.removeProperty(name, nullptr);
+            }
+        }
+        for (auto& property: restored) {
+            tree.setProperty(property.name, property.value, nullptr);
+        }
+        return true;
+    }
+}
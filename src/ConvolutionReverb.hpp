@@ -0,0 +1,687 @@
+/*
+    Copyright 2025 David Whiting
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <JuceHeader.h>
+
+/** An impulse response cut into partitions and transformed, ready to convolve with at one sample rate.
+ *
+ *  The first HEAD_LENGTH samples are in short partitions, which the audio thread convolves with itself so that there's
+ *  no latency, and the rest in long ones which are left to a worker thread. Each partition is stored as the
+ *  non-negative half of the spectrum of it zero-padded to twice its size, as interleaved complex pairs. */
+struct ImpulseResponseSpectra {
+    static constexpr int HEAD_ORDER = 8;
+    static constexpr int HEAD_SIZE = 1 << HEAD_ORDER;
+    static constexpr int TAIL_ORDER = 11;
+    static constexpr int TAIL_SIZE = 1 << TAIL_ORDER;
+    /** The tail starts two of its own partitions in, which gives the worker a whole partition's time to do each one */
+    static constexpr int HEAD_LENGTH = 2 * TAIL_SIZE;
+    static constexpr int HEAD_PARTS = HEAD_LENGTH / HEAD_SIZE;
+
+    double sampleRate = 0.0;
+    int numChannels = 0;
+    int length = 0;
+    int numTailParts = 0;
+    /** By channel, with the partitions one after another */
+    std::array<std::vector<float>, 2> head, tail;
+
+    static constexpr int spectrumSize(int partitionSize) {
+        return 2 * partitionSize + 2;
+    }
+
+    double getLengthSeconds() const {
+        return length / sampleRate;
+    }
+};
+
+/** Overlap-add convolution of one channel with equal sized partitions of an impulse response, in the frequency domain.
+ *  The newest partition is recalculated on every call so there's no latency however few samples it's given, while the
+ *  older ones are only summed once, when each new partition begins. */
+class UniformConvolution {
+    private:
+    const int size;
+    const int spectrumSize;
+    const int numParts;
+    /** Owned by the ImpulseResponseSpectra */
+    const float* const impulse;
+
+    dsp::FFT fft;
+    /** The partition being filled, zero-padded */
+    std::vector<float> input;
+    /** Spectra of the last numParts partitions of input, newest at current and getting older from there */
+    std::vector<float> history;
+    /** The older partitions' contribution to the current output partition */
+    std::vector<float> older;
+    std::vector<float> work;
+    std::vector<float> overlap;
+    int position = 0;
+    int current = 0;
+
+    static void multiplyAccumulate(float* sum, const float* a, const float* b, int numFloats) {
+        for (int i = 0; i < numFloats; i += 2) {
+            sum[i] += a[i] * b[i] - a[i + 1] * b[i + 1];
+            sum[i + 1] += a[i] * b[i + 1] + a[i + 1] * b[i];
+        }
+    }
+
+    /** Not every FFT backend fills in the negative frequencies itself before an inverse transform */
+    void mirrorSpectrum() {
+        auto fftSize = 2 * size;
+        for (int i = 1; i < size; i++) {
+            work[(size_t) (2 * (fftSize - i))] = work[(size_t) (2 * i)];
+            work[(size_t) (2 * (fftSize - i) + 1)] = -work[(size_t) (2 * i + 1)];
+        }
+    }
+
+    public:
+    /** Partitions of 1 << order samples, with their spectra laid out as in ImpulseResponseSpectra */
+    UniformConvolution(int order, int numParts, const float* impulse)
+        : size(1 << order), spectrumSize(ImpulseResponseSpectra::spectrumSize(1 << order)), numParts(numParts),
+          impulse(impulse), fft(order + 1),
+          input((size_t) size * 2), history((size_t) (numParts * spectrumSize)), older((size_t) spectrumSize),
+          work((size_t) size * 4), overlap((size_t) size) {
+    }
+
+    void reset() {
+        for (auto* buffer: { &input, &history, &older, &overlap }) {
+            std::fill(buffer->begin(), buffer->end(), 0.0f);
+        }
+        position = 0;
+        current = 0;
+    }
+
+    /** In place, any number of samples at a time */
+    void process(float* samples, int numSamples) {
+        for (int done = 0; done < numSamples;) {
+            auto n = jmin(numSamples - done, size - position);
+            auto* newest = history.data() + current * spectrumSize;
+
+            std::copy(samples + done, samples + done + n, input.begin() + position);
+            std::copy(input.begin(), input.end(), work.begin());
+            fft.performRealOnlyForwardTransform(work.data(), true);
+            std::copy(work.begin(), work.begin() + spectrumSize, newest);
+
+            if (position == 0) {
+                std::fill(older.begin(), older.end(), 0.0f);
+                for (int part = 1; part < numParts; part++) {
+                    auto index = (current + part) % numParts;
+                    multiplyAccumulate(older.data(), history.data() + index * spectrumSize,
+                                       impulse + part * spectrumSize, spectrumSize);
+                }
+            }
+
+            std::copy(older.begin(), older.end(), work.begin());
+            multiplyAccumulate(work.data(), newest, impulse, spectrumSize);
+            mirrorSpectrum();
+            fft.performRealOnlyInverseTransform(work.data());
+
+            FloatVectorOperations::add(samples + done, work.data() + position, overlap.data() + position, n);
+            position += n;
+            done += n;
+
+            if (position == size) {
+                std::copy(work.begin() + size, work.begin() + 2 * size, overlap.begin());
+                std::fill(input.begin(), input.begin() + size, 0.0f);
+                position = 0;
+                current = (current + numParts - 1) % numParts;
+            }
+        }
+    }
+};
+
+/** Builds the spectra of each IR file at each sample rate, shared between every Crypt instance in the process, so a
+ *  session full of pads all using the same room only reads and transforms the file once. Entries are only kept alive
+ *  by the instances using them. */
+class ImpulseResponseCache {
+    private:
+    using Spectra = ImpulseResponseSpectra;
+
+    /** Anything longer is cut off, there's no point convolving minutes of near-silence */
+    static constexpr double MAX_SECONDS = 12.0;
+    /** Anything quieter than -80dB at the start or the end is trimmed off */
+    static constexpr float SILENCE = 1.0e-4f;
+
+    struct Entry {
+        /** Held while the spectra are built, so instances loading the same IR at once only build it once */
+        CriticalSection building;
+        std::weak_ptr<const Spectra> spectra;
+    };
+
+    CriticalSection lock;
+    std::map<String, std::shared_ptr<Entry>> entries;
+    AudioFormatManager formats;
+
+    /** Reads samples of the IR, at the target rate, into the start of a buffer */
+    using Source = std::function<void(AudioBuffer<float>&, int64, int)>;
+
+    /** Memory-mapped where the format supports it, so the file can be read a piece at a time straight from the mapping
+     *  without ever holding a decoded copy of the whole thing */
+    std::unique_ptr<AudioFormatReader> createReader(const File& file) {
+        if (auto* format = formats.findFormatForFileExtension(file.getFileExtension())) {
+            std::unique_ptr<MemoryMappedAudioFormatReader> mapped(format->createMemoryMappedReader(file));
+            if (mapped != nullptr && mapped->mapEntireFile()) {
+                return mapped;
+            }
+        }
+        return std::unique_ptr<AudioFormatReader>(formats.createReaderFor(file));
+    }
+
+    static std::unique_ptr<AudioBuffer<float>> resample(AudioFormatReader& reader, int channels, double sampleRate,
+                                                        int64 maxLength) {
+        auto ratio = reader.sampleRate / sampleRate;
+        auto length = (int) jmin(reader.lengthInSamples, (int64) ((double) maxLength * ratio));
+        AudioBuffer<float> source(channels, length);
+        reader.read(&source, 0, length, 0, true, channels > 1);
+
+        auto resampledLength = (int) (length / ratio);
+        auto resampled = std::make_unique<AudioBuffer<float>>(channels, resampledLength);
+        for (int c = 0; c < channels; c++) {
+            LagrangeInterpolator interpolator;
+            interpolator.process(ratio, source.getReadPointer(c), resampled->getWritePointer(c), resampledLength,
+                                 length, 0);
+        }
+        return resampled;
+    }
+
+    /** Transforms numParts partitions of the given order from the trimmed IR, starting offset samples into it */
+    static void transform(const Source& source, int64 start, int length, float gain, int order, int offset,
+                          int numParts, int numChannels, std::array<std::vector<float>, 2>& destination) {
+        auto size = 1 << order;
+        auto spectrumSize = Spectra::spectrumSize(size);
+        dsp::FFT fft(order + 1);
+        AudioBuffer<float> partition(numChannels, size);
+        std::vector<float> work((size_t) size * 4);
+
+        for (int c = 0; c < numChannels; c++) {
+            destination[(size_t) c].resize((size_t) (numParts * spectrumSize));
+        }
+        for (int part = 0; part < numParts; part++) {
+            auto from = offset + part * size;
+            auto n = jlimit(0, size, length - from);
+            partition.clear();
+            if (n > 0) {
+                source(partition, start + from, n);
+            }
+            for (int c = 0; c < numChannels; c++) {
+                std::fill(work.begin(), work.end(), 0.0f);
+                FloatVectorOperations::copyWithMultiply(work.data(), partition.getReadPointer(c), gain, size);
+                fft.performRealOnlyForwardTransform(work.data(), true);
+                std::copy(work.begin(), work.begin() + spectrumSize,
+                          destination[(size_t) c].begin() + part * spectrumSize);
+            }
+        }
+    }
+
+    std::shared_ptr<const Spectra> build(const File& file, double sampleRate) {
+        auto reader = createReader(file);
+        if (reader == nullptr || reader->lengthInSamples <= 0 || reader->sampleRate <= 0.0) {
+            return nullptr;
+        }
+
+        auto channels = jlimit(1, 2, (int) reader->numChannels);
+        auto maxLength = (int64) (sampleRate * MAX_SECONDS);
+
+        int64 length;
+        Source source;
+        std::unique_ptr<AudioBuffer<float>> resampled;
+        if (approximatelyEqual(reader->sampleRate, sampleRate)) {
+            length = jmin(reader->lengthInSamples, maxLength);
+            source = [&reader, channels] (AudioBuffer<float>& destination, int64 start, int numSamples) {
+                reader->read(&destination, 0, numSamples, start, true, channels > 1);
+            };
+        } else {
+            // Resampling needs it all in memory anyway
+            resampled = resample(*reader, channels, sampleRate, maxLength);
+            length = resampled->getNumSamples();
+            source = [&resampled] (AudioBuffer<float>& destination, int64 start, int numSamples) {
+                for (int c = 0; c < destination.getNumChannels(); c++) {
+                    destination.copyFrom(c, 0, *resampled, c, (int) start, numSamples);
+                }
+            };
+        }
+
+        // First pass to find where the sound starts and ends, and how much energy it has
+        AudioBuffer<float> chunk(channels, Spectra::TAIL_SIZE);
+        int64 first = -1;
+        int64 last = -1;
+        std::array<double, 2> energy {};
+        for (int64 start = 0; start < length; start += chunk.getNumSamples()) {
+            auto n = (int) jmin((int64) chunk.getNumSamples(), length - start);
+            source(chunk, start, n);
+            for (int c = 0; c < channels; c++) {
+                auto* samples = chunk.getReadPointer(c);
+                for (int i = 0; i < n; i++) {
+                    energy[(size_t) c] += samples[i] * samples[i];
+                    if (std::abs(samples[i]) > SILENCE) {
+                        first = first < 0 ? start + i : jmin(first, start + i);
+                        last = jmax(last, start + i);
+                    }
+                }
+            }
+        }
+        if (first < 0) {
+            return nullptr;
+        }
+
+        // Then the partitions, normalised so that every IR comes out at about the same level
+        auto spectra = std::make_shared<Spectra>();
+        spectra->sampleRate = sampleRate;
+        spectra->numChannels = channels;
+        spectra->length = (int) (last + 1 - first);
+        spectra->numTailParts = jmax(0, spectra->length - Spectra::HEAD_LENGTH + Spectra::TAIL_SIZE - 1)
+                                / Spectra::TAIL_SIZE;
+        auto gain = (float) (1.0 / std::sqrt(jmax(energy[0], energy[1])));
+
+        transform(source, first, spectra->length, gain, Spectra::HEAD_ORDER, 0, Spectra::HEAD_PARTS, channels,
+                  spectra->head);
+        transform(source, first, spectra->length, gain, Spectra::TAIL_ORDER, Spectra::HEAD_LENGTH,
+                  spectra->numTailParts, channels, spectra->tail);
+        return spectra;
+    }
+
+    public:
+    ImpulseResponseCache() {
+        formats.registerBasicFormats();
+    }
+
+    /** Blocks while the spectra are built if nobody else has them, so only call from a background thread. The file
+     *  is read outside the cache's lock, so only loads of the same IR at the same rate wait for each other */
+    std::shared_ptr<const Spectra> get(const File& file, double sampleRate) {
+        std::shared_ptr<Entry> entry;
+        {
+            const ScopedLock sl(lock);
+            // Forget whatever nobody is using or building any more
+            for (auto it = entries.begin(); it != entries.end();) {
+                auto unused = it->second.use_count() == 1 && it->second->spectra.expired();
+                it = unused ? entries.erase(it) : std::next(it);
+            }
+
+            auto& slot = entries[file.getFullPathName() + "@" + String(sampleRate)];
+            if (slot == nullptr) {
+                slot = std::make_shared<Entry>();
+            }
+            entry = slot;
+        }
+
+        const ScopedLock sl(entry->building);
+        if (auto existing = entry->spectra.lock()) {
+            return existing;
+        }
+        auto spectra = build(file, sampleRate);
+        entry->spectra = spectra;
+        return spectra;
+    }
+};
+
+/** The convolution with one set of spectra, made on the loader thread with everything it needs allocated up front.
+ *
+ *  The audio thread convolves with the head partitions itself. It also gathers the input into blocks of TAIL_SIZE and
+ *  passes each one to a worker thread through a FIFO; the worker convolves it with the tail partitions and publishes
+ *  the result, which the audio thread mixes in when the output reaches it, a whole block later. In real time a piece
+ *  of the tail the worker hasn't finished by then is dropped rather than waited for. Offline the audio thread waits. */
+class ConvolutionEngine: private Thread {
+    private:
+    using Spectra = ImpulseResponseSpectra;
+
+    static constexpr int TAIL_SIZE = Spectra::TAIL_SIZE;
+    static constexpr int INPUT_SLOTS = 4;
+    /** Enough that the worker can never be writing the one the audio thread is reading */
+    static constexpr int OUTPUT_SLOTS = 8;
+
+    struct InputBlock {
+        int64 index = 0;
+        /** First block since a reset, so the tail starts again from silence */
+        bool clear = false;
+        std::array<std::vector<float>, 2> samples;
+    };
+
+    struct OutputBlock {
+        /** Which input block this is the tail of, set once it's complete */
+        std::atomic<int64> index { -1 };
+        std::array<std::vector<float>, 2> samples;
+    };
+
+    const std::shared_ptr<const Spectra> spectra;
+    const bool hasTail;
+
+    AbstractFifo fifo { INPUT_SLOTS };
+    std::array<InputBlock, INPUT_SLOTS> inputs;
+    std::array<OutputBlock, OUTPUT_SLOTS> outputs;
+    WaitableEvent blockFinished;
+
+    // Audio thread only
+    std::array<std::unique_ptr<UniformConvolution>, 2> heads;
+    std::array<std::vector<float>, 2> staging;
+    int staged = 0;
+    /** The tail for the block being staged, looked up as it starts so that it's either there or not for all of it */
+    const OutputBlock* currentTail = nullptr;
+    int64 blockIndex = 0;
+    int64 firstBlock = 0;
+    bool clearPending = true;
+
+    // Worker only
+    std::array<std::unique_ptr<UniformConvolution>, 2> tails;
+    int64 nextIndex = 0;
+
+    /** The tail of the given block if it's ready, or null */
+    const OutputBlock* findTail(int64 index, bool realtime) {
+        // Nothing from before the last reset
+        if (index < firstBlock) {
+            return nullptr;
+        }
+        auto& output = outputs[(size_t) (index % OUTPUT_SLOTS)];
+        while (! realtime && output.index.load(std::memory_order_acquire) != index && blockFinished.wait(1000)) {}
+        return output.index.load(std::memory_order_acquire) == index ? &output : nullptr;
+    }
+
+    void submit(bool realtime) {
+        while (! realtime && fifo.getFreeSpace() == 0 && blockFinished.wait(1000)) {}
+
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(1, start1, size1, start2, size2);
+        // Otherwise the worker is a long way behind, and this piece of the tail is lost
+        if (size1 > 0) {
+            auto& input = inputs[(size_t) start1];
+            input.index = blockIndex;
+            input.clear = clearPending;
+            for (size_t c = 0; c < 2; c++) {
+                std::copy(staging[c].begin(), staging[c].end(), input.samples[c].begin());
+            }
+            fifo.finishedWrite(1);
+            clearPending = false;
+            notify();
+        }
+    }
+
+    void processTail(const InputBlock& input) {
+        // Blocks only go missing when it's fallen behind, in which case the tail is better off starting again too
+        if (input.clear || input.index != nextIndex) {
+            for (auto& tail: tails) {
+                tail->reset();
+            }
+        }
+        nextIndex = input.index + 1;
+
+        auto& output = outputs[(size_t) (input.index % OUTPUT_SLOTS)];
+        for (size_t c = 0; c < 2; c++) {
+            std::copy(input.samples[c].begin(), input.samples[c].end(), output.samples[c].begin());
+            tails[c]->process(output.samples[c].data(), TAIL_SIZE);
+        }
+        output.index.store(input.index, std::memory_order_release);
+    }
+
+    void run() override {
+        while (! threadShouldExit()) {
+            // submit() wakes this up for each block
+            if (fifo.getNumReady() == 0) {
+                wait(-1);
+                continue;
+            }
+            int start1, size1, start2, size2;
+            fifo.prepareToRead(1, start1, size1, start2, size2);
+            processTail(inputs[(size_t) start1]);
+            fifo.finishedRead(1);
+            blockFinished.signal();
+        }
+    }
+
+    public:
+    explicit ConvolutionEngine(std::shared_ptr<const Spectra> spectraToUse)
+        : Thread("Crypt convolution tail"), spectra(std::move(spectraToUse)), hasTail(spectra->numTailParts > 0) {
+        for (size_t c = 0; c < 2; c++) {
+            auto channel = (size_t) jmin((int) c, spectra->numChannels - 1);
+            heads[c] = std::make_unique<UniformConvolution>(Spectra::HEAD_ORDER, Spectra::HEAD_PARTS,
+                                                            spectra->head[channel].data());
+            staging[c].resize(TAIL_SIZE);
+            if (hasTail) {
+                tails[c] = std::make_unique<UniformConvolution>(Spectra::TAIL_ORDER, spectra->numTailParts,
+                                                                spectra->tail[channel].data());
+                for (auto& input: inputs) {
+                    input.samples[c].resize(TAIL_SIZE);
+                }
+                for (auto& output: outputs) {
+                    output.samples[c].resize(TAIL_SIZE);
+                }
+            }
+        }
+        if (hasTail) {
+            startThread(Thread::Priority::high);
+        }
+    }
+
+    ~ConvolutionEngine() override {
+        stopThread(1000);
+    }
+
+    double getSampleRate() const {
+        return spectra->sampleRate;
+    }
+
+    /** Audio thread, when it stops using this engine. The worker finishes up without waiting to be freed */
+    void retire() {
+        signalThreadShouldExit();
+    }
+
+    /** Audio thread, or while it's stopped */
+    void reset() {
+        for (auto& head: heads) {
+            head->reset();
+        }
+        // Start again on a fresh block, ignoring whatever the worker still has of the old ones
+        staged = 0;
+        currentTail = nullptr;
+        firstBlock = ++blockIndex;
+        clearPending = true;
+    }
+
+    /** Audio thread only. Replaces the stereo input with the fully wet signal */
+    void process(const dsp::AudioBlock<float>& block, bool realtime) {
+        auto numChannels = jmin((int) block.getNumChannels(), 2);
+        auto numSamples = (int) block.getNumSamples();
+        for (int done = 0; done < numSamples;) {
+            // Never crossing into the next block, so the tail output comes from one place
+            auto n = jmin(numSamples - done, TAIL_SIZE - staged);
+            if (staged == 0) {
+                currentTail = hasTail ? findTail(blockIndex - Spectra::HEAD_LENGTH / TAIL_SIZE, realtime) : nullptr;
+            }
+            auto* tail = currentTail;
+
+            for (int c = 0; c < numChannels; c++) {
+                auto* samples = block.getChannelPointer((size_t) c) + done;
+                std::copy(samples, samples + n, staging[(size_t) c].begin() + staged);
+                heads[(size_t) c]->process(samples, n);
+                if (tail != nullptr) {
+                    FloatVectorOperations::add(samples, tail->samples[(size_t) c].data() + staged, n);
+                }
+            }
+
+            staged += n;
+            done += n;
+            if (staged == TAIL_SIZE) {
+                if (hasTail) {
+                    submit(realtime);
+                }
+                staged = 0;
+                blockIndex++;
+            }
+        }
+    }
+};
+
+/** Runs the signal through a real space loaded from disk.
+ *
+ *  The IR's spectra come from the shared cache on a background thread, where a ConvolutionEngine is made for them and
+ *  then handed to the audio thread under a SpinLock it only ever tries to take, like the PreviewPlayer's clips. The
+ *  audio thread never frees an engine either: the one it stops using has its worker told to stop, and is parked until
+ *  the next handover. Until there's an engine for the current sample rate, the signal passes through untouched. */
+class ConvolutionReverb {
+    private:
+    /** Both only created the first time an IR is loaded, as most instances never will */
+    std::optional<SharedResourcePointer<ImpulseResponseCache>> cache;
+    std::unique_ptr<ThreadPool> loader;
+    /** Guards the two above and file. Never taken on the audio thread */
+    CriticalSection loaderLock;
+    File file;
+
+    std::atomic<double> sampleRate { 0.0 };
+    std::atomic<bool> realtime { true };
+    std::atomic<float> wetLevel { 0.0f };
+    std::atomic<float> dryLevel { 1.0f };
+    std::atomic<double> lengthSeconds { 0.0 };
+    /** Bumped on every load, so a slow load that's been superseded doesn't get applied when it finishes */
+    std::atomic<int> generation { 0 };
+
+    SpinLock lock;
+    // Guarded by lock
+    std::unique_ptr<ConvolutionEngine> pending;
+    bool hasPending = false;
+    std::unique_ptr<ConvolutionEngine> retired;
+
+    // Audio thread only
+    std::unique_ptr<ConvolutionEngine> engine;
+    /** Copy of the input, preallocated in prepare */
+    AudioBuffer<float> dry;
+
+    void handOver(std::unique_ptr<ConvolutionEngine> next) {
+        std::unique_ptr<ConvolutionEngine> released, superseded;
+        {
+            const SpinLock::ScopedLockType sl(lock);
+            released = std::move(retired);
+            superseded = std::move(pending);
+            pending = std::move(next);
+            hasPending = true;
+        }
+        // The previous engines are stopped and freed here, outside the lock
+    }
+
+    /** Needs loaderLock */
+    void startLoading() {
+        auto thisLoad = ++generation;
+        if (loader != nullptr) {
+            loader->removeAllJobs(true, 0);
+        }
+        if (file == File()) {
+            lengthSeconds = 0.0;
+            handOver(nullptr);
+            return;
+        }
+
+        // Nothing to build the spectra for until there's a sample rate; prepare() starts the load again then
+        auto rate = sampleRate.load();
+        if (rate <= 0.0) {
+            return;
+        }
+        if (loader == nullptr) {
+            cache.emplace();
+            loader = std::make_unique<ThreadPool>(1);
+        }
+        loader->addJob([this, fileToLoad = file, rate, thisLoad] {
+            auto spectra = (*cache)->get(fileToLoad, rate);
+            auto next = spectra != nullptr ? std::make_unique<ConvolutionEngine>(spectra) : nullptr;
+
+            const ScopedLock sl(loaderLock);
+            if (generation == thisLoad) {
+                lengthSeconds = spectra != nullptr ? spectra->getLengthSeconds() : 0.0;
+                handOver(std::move(next));
+            }
+        });
+    }
+
+    public:
+    ~ConvolutionReverb() {
+        if (loader != nullptr) {
+            loader->removeAllJobs(true, 10000);
+        }
+    }
+
+    /** Any thread */
+    void setParameters(float wet, float dryMix) {
+        wetLevel = wet;
+        dryLevel = dryMix;
+    }
+
+    /** Any thread. Offline, the audio thread waits for the tail rather than letting it drop out */
+    void setNonRealtime(bool isNonRealtime) {
+        realtime = ! isNonRealtime;
+    }
+
+    /** Load an IR in the background, replacing whatever was loaded before once it's ready. Call from any thread
+     *  apart from the audio thread */
+    void load(const File& fileToLoad) {
+        const ScopedLock sl(loaderLock);
+        file = fileToLoad;
+        startLoading();
+    }
+
+    void unload() {
+        load(File());
+    }
+
+    double getTailLengthSeconds() const {
+        return lengthSeconds;
+    }
+
+    /** The spectra are made for one sample rate, so a new one means loading the IR again */
+    void prepare(const dsp::ProcessSpec& spec) {
+        dry.setSize((int) spec.numChannels, (int) spec.maximumBlockSize);
+        if (! approximatelyEqual(sampleRate.exchange(spec.sampleRate), spec.sampleRate)) {
+            const ScopedLock sl(loaderLock);
+            startLoading();
+        }
+    }
+
+    void reset() {
+        if (engine != nullptr) {
+            engine->reset();
+        }
+    }
+
+    void process(const dsp::ProcessContextReplacing<float>& context) {
+        {
+            const SpinLock::ScopedTryLockType tl(lock);
+            // Only take the new engine if the last retired one has been released, so nothing is freed here
+            if (tl.isLocked() && hasPending && retired == nullptr) {
+                retired = std::move(engine);
+                engine = std::move(pending);
+                hasPending = false;
+                if (retired != nullptr) {
+                    retired->retire();
+                }
+            }
+        }
+        if (engine == nullptr || ! approximatelyEqual(engine->getSampleRate(), sampleRate.load())) {
+            return;
+        }
+
+        auto block = context.getOutputBlock();
+        auto channels = jmin((int) block.getNumChannels(), dry.getNumChannels());
+        auto samples = jmin((int) block.getNumSamples(), dry.getNumSamples());
+
+        for (int c = 0; c < channels; c++) {
+            FloatVectorOperations::copy(dry.getWritePointer(c), block.getChannelPointer((size_t) c), samples);
+        }
+
+        engine->process(block, realtime);
+
+        auto wet = wetLevel.load();
+        auto dryMix = dryLevel.load();
+        for (int c = 0; c < channels; c++) {
+            auto* out = block.getChannelPointer((size_t) c);
+            FloatVectorOperations::multiply(out, wet, samples);
+            FloatVectorOperations::addWithMultiply(out, dry.getReadPointer(c), dryMix, samples);
+        }
+    }
+};
@@ -22,7 +22,15 @@
 #include "ParameterControlledADSR.hpp"
 #include "SuperSawVoice.hpp"
 #include "SharedBuffer.hpp"
+#include "SpectrumAnalyser.hpp"
 #include "FxProcessors.hpp"
+#include "RenderQuality.hpp"
+#include "BinaryState.hpp"
+#include "MidiInjectionQueue.hpp"
+#include "ParameterControlledLFO.hpp"
+#include "PresetMorph.hpp"
+#include "PreviewPlayer.hpp"
+#include "CryptPresetBank.h"
 
 /** This needs to exist to satisfy the needs of the Synthesiser class, but is otherwise meaningless */
 class AlwaysOnSound : public SynthesiserSound {
@@ -36,79 +44,238 @@ public:
 
 };
 
-/*  The simple presets in Crypt are managed by a baked-in XML file, containing a set of possible plugin
-    states in the same form as they are saved by the createXml function of an AudioProcessorValueTreeState.
-    This baked-in XML is a BinaryData resource in resources/presets.xml */
-struct Preset {
-    int id;
-    String name;
-    std::unique_ptr<XmlElement> stateData;
-};
-
+/*  The simple presets in Crypt are baked in at build time: resources/presets.xml, in the same form as the
+    createXml function of an AudioProcessorValueTreeState saves a state, is turned into constexpr tables in
+    CryptPresetBank.h by cmake/GeneratePresetBank.cmake. So there's nothing to load when an instance is created. */
 class PresetManager {
-    typedef std::pair<String, std::unique_ptr<XmlElement>> NamedPreset;
-
-    private:
-    std::vector<Preset> presetData;
-
-    void loadPresets() {
-        DBG("Loading Preset");
-        String content (BinaryData::presets_xml);
-        auto parsed = parseXML(content);
-
-        if (parsed) {
-            DBG("Document parsed successfully");
-            if (parsed->hasTagName("presets")) {
-                DBG("Presets as top level tag, good!");
-                int n = 1;
-                for (auto preset: parsed->getChildIterator()) {
-                    auto name = preset->getChildByName("name")->getAllSubText();
-                    DBG("Loading preset " << name);
-                    auto element = std::make_unique<XmlElement>(*(preset->getChildByName("state")));
-                    presetData.push_back({n++, name, std::move(element)});
-                    DBG("successfully inserted into map");
+    public:
+    /** Settings about how to render rather than what it sounds like, and the morph between presets itself, so they
+     *  stay as they are when a preset is loaded */
+    static bool isPresetIndependent(const String& parameterID) {
+        return parameterID == CryptParameters::OfflineQuality || parameterID == CryptParameters::EcoMode
+            || parameterID == CryptParameters::Morph;
+    }
+
+    /** index starts from 1, as used for the preset menu IDs. Parameters the preset lists get its values, and the rest
+     *  their defaults. Empty if there's no such preset */
+    ParameterSnapshot createSnapshot(int index, AudioProcessorValueTreeState &state) {
+        if (index < 1 || index > CryptPresetBank::numPresets) {
+            return {};
+        }
+        auto& preset = CryptPresetBank::presets[index - 1];
+        auto& parameters = state.processor.getParameters();
+
+        ParameterSnapshot snapshot((size_t) parameters.size(), std::numeric_limits<float>::quiet_NaN());
+        for (auto* parameter: parameters) {
+            auto* ranged = dynamic_cast<RangedAudioParameter*>(parameter);
+            if (ranged == nullptr || isPresetIndependent(ranged->paramID)) {
+                continue;
+            }
+
+            auto normalised = ranged->getDefaultValue();
+            for (int i = 0; i < preset.numValues; i++) {
+                if (ranged->paramID == preset.values[i].id) {
+                    normalised = ranged->convertTo0to1(preset.values[i].value);
+                    break;
                 }
             }
-        } else {
-            DBG("Failed XML Parse");
+            snapshot[(size_t) parameter->getParameterIndex()] = normalised;
         }
+        return snapshot;
     }
-    public:
 
-    PresetManager() {
-        loadPresets();
+    /** Whatever the parameters are set to now, eg. after restoring a session */
+    ParameterSnapshot captureSnapshot(AudioProcessorValueTreeState &state) {
+        auto& parameters = state.processor.getParameters();
+        ParameterSnapshot snapshot((size_t) parameters.size(), std::numeric_limits<float>::quiet_NaN());
+        for (auto* parameter: parameters) {
+            auto* ranged = dynamic_cast<RangedAudioParameter*>(parameter);
+            if (ranged != nullptr && ! isPresetIndependent(ranged->paramID)) {
+                snapshot[(size_t) parameter->getParameterIndex()] = parameter->getValue();
+            }
+        }
+        return snapshot;
     }
 
+    /** Sets the parameters straight away on this thread. Only the ones which actually change are touched, so voices
+     *  and FX don't get woken up for nothing */
     void applyPreset(int index, AudioProcessorValueTreeState &state) {
-        state.replaceState(ValueTree::fromXml(*presetData[index-1].stateData.get()));
+        applySnapshot(state.processor.getParameters(), createSnapshot(index, state));
+    }
+
+    /** A snapshot as text, to keep in the state tree: ID=value pairs, unnormalised so that they survive a change of
+     *  range like BinaryState's do */
+    String snapshotToString(const ParameterSnapshot& snapshot, AudioProcessorValueTreeState &state) {
+        StringArray entries;
+        for (auto* parameter: state.processor.getParameters()) {
+            auto* ranged = dynamic_cast<RangedAudioParameter*>(parameter);
+            auto index = (size_t) parameter->getParameterIndex();
+            if (ranged != nullptr && index < snapshot.size() && ! std::isnan(snapshot[index])) {
+                entries.add(ranged->paramID + "=" + String(ranged->convertFrom0to1(snapshot[index])));
+            }
+        }
+        return entries.joinIntoString(";");
+    }
+
+    /** The other way round from snapshotToString. Empty if there's nothing in the text */
+    ParameterSnapshot snapshotFromString(const String& text, AudioProcessorValueTreeState &state) {
+        if (text.isEmpty()) {
+            return {};
+        }
+        auto& parameters = state.processor.getParameters();
+        ParameterSnapshot snapshot((size_t) parameters.size(), std::numeric_limits<float>::quiet_NaN());
+        for (auto& entry: StringArray::fromTokens(text, ";", "")) {
+            if (auto* parameter = state.getParameter(entry.upToFirstOccurrenceOf("=", false, false))) {
+                auto value = entry.fromFirstOccurrenceOf("=", false, false).getFloatValue();
+                snapshot[(size_t) parameter->getParameterIndex()] = parameter->convertTo0to1(value);
+            }
+        }
+        return snapshot;
     }
 
     std::vector<StringRef> listPresets() {
-        std::vector<StringRef> result(presetData.size());
-        std::transform(presetData.begin(), presetData.end(), result.begin(), [](Preset& x) { return x.name; });
+        std::vector<StringRef> result;
+        for (auto& preset: CryptPresetBank::presets) {
+            result.push_back(preset.name);
+        }
         return result;
     }
 };
 
 
 /** The plugin itself */
-class CryptAudioProcessor  : public AudioProcessor {
+class CryptAudioProcessor  : public AudioProcessor, private Timer {
     friend class CryptAudioProcessorEditor;
 private:
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CryptAudioProcessor)
 
+    /** Only renders audio, eg. the preset library's clips: see Mode */
+    const bool headless;
+
+    bool dspCreated = false;
+
+    /** Hosts create the plugin just to scan it, or to restore a session before anything plays, so the voices and the
+     *  parameter wiring for the DSP are left until the first prepareToPlay. Everything reads the current parameter
+     *  values as it starts listening, so whatever state was restored in the meantime is picked up */
+    void createDsp() {
+        if (dspCreated) {
+            return;
+        }
+        dspCreated = true;
+
+        for (int i = 0; i < MAX_POLYPHONY; i++) {
+            // The synth takes ownership of the voices, so this 'new' is safe
+            synth.addVoice(new SuperSawVoice(state, globalModulation));
+        }
+        fxRig.get<0>().registerParams(state);
+        fxRig.get<1>().registerParams(state);
+        fxRig.get<2>().registerParams(state);
+        renderQuality.registerParams(state);
+        ecoMode.registerParams(state);
+        globalModulation.registerParams(state);
+    }
+
+    /** The phaser's latency is there in eco mode, whether it's bypassed or not; on top of that the voices are late by
+     *  however much the offline oversampling filters delay them */
+    void updateLatency() {
+        setLatencySamples(phaserLatency.load() + renderQuality.getLatencySamples(isNonRealtime()));
+    }
+
+    /** Going in or out of eco mode changes the latency on the audio thread, and the host is told about it from here */
+    void timerCallback() override {
+        if (phaserLatency.load() + renderQuality.getLatencySamples(isNonRealtime()) != getLatencySamples()) {
+            updateLatency();
+        }
+    }
+
+    static constexpr int LATENCY_CHECK_INTERVAL_MS = 100;
+
+    /** Shared by all the voices, so it has to outlive them */
+    GlobalModulation globalModulation;
+
     Synthesiser synth;
 
     dsp::ProcessorChain<Phaser, CryptReverb, StereoDelay> fxRig;
 
-    SharedBuffer oscBuffer;
+    /** One per stage of fxRig, takes it out of the chain when it's bypassed or inaudible */
+    std::array<StageFader, 3> stageFaders;
+
+    RenderQuality renderQuality;
 
+    EcoMode ecoMode;
+
+    /** What the editor's visualiser sees, after the FX */
+    SharedBuffer postFxTap;
+    SpectrumAnalyser spectrum;
+
+    /** Only used by the on-screen keyboard on the message thread, the audio thread sees its notes via midiQueue and
+     *  the host's notes get back to it the same way */
     MidiKeyboardState keyboardState;
 
+    MidiInjectionQueue midiQueue;
+
+    /** Host MIDI plus anything injected, preallocated so that merging doesn't allocate */
+    MidiBuffer mergedMidi;
+
     // This was kind of an arbitrary choice
     const int MAX_POLYPHONY = 8;
 
+    /** The phaser's latency as of the last block */
+    std::atomic<int> phaserLatency { 0 };
+
+    /** Highest absolute output sample since the meter last read it */
+    std::atomic<float> outputPeak { 0.0f };
+
+    /** Number of blocks where a NaN/Inf had to be contained, for long-running numerical checks */
+    std::atomic<int> numericalFaults { 0 };
+
+    /** Cheap check for NaN/Inf anywhere in a block - anything non-finite times zero is NaN, everything else is zero */
+    static bool isFinite(const dsp::AudioBlock<float>& block) {
+        float check = 0.0f;
+        for (size_t c = 0; c < block.getNumChannels(); c++) {
+            auto* data = block.getChannelPointer(c);
+            for (size_t i = 0; i < block.getNumSamples(); i++) {
+                check += data[i] * 0.0f;
+            }
+        }
+        return check == 0.0f;
+    }
+
+    /** Passes the eco mode on to the FX that have one, along with the latency that brings with it */
+    void setEcoStages() {
+        auto ecoStages = ecoMode.getStages();
+        fxRig.get<0>().setEcoStages(ecoStages);
+        fxRig.get<1>().setEcoStages(ecoStages);
+        auto latency = fxRig.get<0>().getLatencySamples();
+        stageFaders[0].setLatency(latency);
+        phaserLatency = latency;
+    }
+
+    /** Run a single FX stage (unless it's bypassed), and if it blows up then reset it and silence the block rather
+     *  than letting the NaN propagate through the rest of the chain and into the host */
+    template <size_t Index>
+    void processFxStage(const dsp::ProcessContextReplacing<float>& context) {
+        auto& stage = fxRig.get<Index>();
+        auto& fader = stageFaders[Index];
+        auto block = context.getOutputBlock();
+
+        auto action = fader.startBlock(stage.isAudible(), block);
+        if (action == StageFader::Action::skip) {
+            return;
+        } else if (action == StageFader::Action::restart) {
+            stage.reset();
+        }
+
+        stage.process(context);
+        if (! isFinite(block)) {
+            stage.reset();
+            block.clear();
+            numericalFaults++;
+        }
+        fader.endBlock(block);
+    }
+
     /* Shortcut for getting true (non-normalised) values out of a parameter tree 
      * I honestly cannot remember why I'm not using getRawParameterValue, but I remember crashes
      * when I tried to rationalise all the parameter stuff and I'm scared to change it now
@@ -129,6 +296,13 @@ private:
                             ParameterControlledADSR::params(CryptParameters::Amplitude));
         auto filterEnv =  createParameterGroup("Filter", "Filter Env", 
                             ParameterControlledADSR::params(CryptParameters::Filter));
+        auto voiceLfo =   createParameterGroup("VoiceLfo", "Voice LFO", SuperSawVoice::lfoParams());
+        auto globalLfo =  createParameterGroup("GlobalLfo", "Global LFO", GlobalModulation::params());
+        auto qualityParams = RenderQuality::params();
+        for (auto p: EcoMode::params()) {
+            qualityParams.push_back(p);
+        }
+        auto quality =    createParameterGroup("Quality", "Quality", qualityParams);
         
         return {
             std::move(oscillator),
@@ -137,7 +311,15 @@ private:
             std::move(reverb),
             std::move(ampEnv),
             std::move(filterEnv),
+            std::move(voiceLfo),
+            std::move(globalLfo),
+            std::move(quality),
             std::make_unique<AudioParameterFloat>(
+                ParameterID {CryptParameters::Morph, 1},
+                "Preset Morph",
+                NormalisableRange<float>(0.0, 1.0, 0.001),
+                0.0f),
+            std::make_unique<AudioProcessorValueTreeState::Parameter>(
                 ParameterID {CryptParameters::Master, 1},
                 "Master Gain",
                 NormalisableRange<float>(-12.0,3.0,0.01),
@@ -151,41 +333,146 @@ public:
 
     PresetManager presetManager;
 
+    /** Applies preset changes from the audio thread; needs the parameters to exist already */
+    PresetMorph presetMorph { state, ! headless };
+
+    /** Audition clips from the preset browser */
+    PreviewPlayer previewPlayer;
+
+    /** A headless processor is for rendering on a background thread with nobody watching. It starts none of the timers
+     *  which report parameter and latency changes to the host from the message thread, so nothing touches it from
+     *  there; the only one left is the one inside the AudioProcessorValueTreeState. The visualisers and the preview
+     *  player only start their threads once something uses them, so a headless one never has any threads of its own */
+    enum class Mode { plugin, headless };
+
     /** Create plugin with Stereo output and setup all the parameters */
-    CryptAudioProcessor() :
+    explicit CryptAudioProcessor(Mode mode = Mode::plugin) :
             AudioProcessor(BusesProperties().withOutput ("Output", juce::AudioChannelSet::stereo(), true)),
+            headless(mode == Mode::headless),
             state(*this, nullptr, "state", createCryptParameterLayout()),
-            oscBuffer(512) {
-
-        // Add some voices to our empty synthesiser
-        for (int i = 0; i < MAX_POLYPHONY; i++) {
-            // The synth takes ownership of the voices, so this 'new' is safe
-            auto voice = new SuperSawVoice(state);
-            synth.addVoice(voice);
-        }
+            postFxTap(512) {
         // The synth takes ownership of the Sound, so this 'new' is safe
         synth.addSound(new AlwaysOnSound());
-        fxRig.get<0>().registerParams(state);
-        fxRig.get<1>().registerParams(state);
-        fxRig.get<2>().registerParams(state);
+        keyboardState.addListener(&midiQueue);
+        if (! headless) {
+            startTimer(LATENCY_CHECK_INTERVAL_MS);
+        }
     }
     ~CryptAudioProcessor() override {
+        stopTimer();
+        // Removing listeners that were never added (if this never got prepared) is harmless
         fxRig.get<0>().unRegisterParams(state);
         fxRig.get<1>().unRegisterParams(state);
         fxRig.get<2>().unRegisterParams(state);
+        renderQuality.unRegisterParams(state);
+        ecoMode.unRegisterParams(state);
+        globalModulation.unRegisterParams(state);
+        keyboardState.removeListener(&midiQueue);
     }
 
     /** Before playing for the first time we need to inform components of the current sample rate, and do an inital setup
      * of the Reverb processor parameters
      */
     void prepareToPlay (double sampleRate, int samplesPerBlock) override {
-        synth.setCurrentPlaybackSampleRate(sampleRate);
+        // The first use of the kernels checks the environment for CRYPT_FORCE_ISA, so get that done off the audio thread
+        DspKernels::get();
+
+        createDsp();
+        renderQuality.prepare(synth, sampleRate, samplesPerBlock, isNonRealtime());
+        // Room for the most oversampled block
+        globalModulation.prepare(samplesPerBlock * 8);
+        mergedMidi.ensureSize(4096);
         fxRig.prepare({.sampleRate = sampleRate, .maximumBlockSize = (uint32)samplesPerBlock, .numChannels = 2});
+        stageFaders[0].prepare({.sampleRate = sampleRate, .maximumBlockSize = (uint32)samplesPerBlock, .numChannels = 2},
+                               Phaser::ECO_LATENCY);
+        setEcoStages();
+        stageFaders[1].prepare({.sampleRate = sampleRate, .maximumBlockSize = (uint32)samplesPerBlock, .numChannels = 2});
+        stageFaders[2].prepare({.sampleRate = sampleRate, .maximumBlockSize = (uint32)samplesPerBlock, .numChannels = 2});
+        updateLatency();
+        previewPlayer.prepare(sampleRate);
+        spectrum.prepare(sampleRate);
+    }
+
+    /** Hosts switch this on for bounces, which may change the render quality and with it the latency. The synth
+     *  itself picks up the new rate at the start of the next block */
+    void setNonRealtime(bool isNonRealtime) noexcept override {
+        AudioProcessor::setNonRealtime(isNonRealtime);
+        updateLatency();
     }
 
     /** Everything we've allocated will be self-destructed, so there's no resources to release */
     void releaseResources() override {}
 
+    /** Stops every voice dead and clears the FX tails, eg. when the host jumps to somewhere else in the timeline */
+    void reset() override {
+        synth.allNotesOff(0, false);
+        renderQuality.reset();
+        fxRig.reset();
+    }
+
+    int getNumericalFaults() const { return numericalFaults; }
+
+    /** Lets a CPU governor force the phaser and reverb down to half (1) or quarter (2) rate regardless of the Eco
+     *  Mode setting, or hand control back to it (0). Safe to call from any thread */
+    void setEcoGovernor(int stages) { ecoMode.setGovernorSetting(stages); }
+
+    /** Peak level of the output since the last call, for metering. Call from one thread only */
+    float getAndResetOutputPeak() { return outputPeak.exchange(0.0f); }
+
+    /** Play a short MIDI message into the synth without going through the host, eg. from a test harness. Call from
+     *  one thread only (the on-screen keyboard already uses this from the message thread) */
+    bool injectMidi(const MidiMessage& message, int samplePosition = 0) {
+        return midiQueue.push(message, samplePosition);
+    }
+
+    /** Use an impulse response file for the Void's convolution mode, and switch over to that mode. The path goes in
+     *  the state so it's saved with the session; the reverb notices it change and loads it in the background */
+    void setImpulseResponse(const File& file) {
+        state.state.setProperty(Identifier(CryptParameters::ImpulseResponsePath), file.getFullPathName(), nullptr);
+        auto mode = state.getParameter(CryptParameters::ReverbMode);
+        mode->setValueNotifyingHost(mode->convertTo0to1(2.0f));
+    }
+
+    /** Switch to a preset without interrupting the sound; the audio thread applies the whole preset at once at the
+     *  start of its next block, and it becomes the starting point for the morph. Message thread only */
+    void loadPreset(int index) {
+        auto snapshot = presetManager.createSnapshot(index, state);
+        if (snapshot.empty()) {
+            return;
+        }
+        loadSnapshot(snapshot);
+        // None of the presets use an impulse response
+        state.state.removeProperty(Identifier(CryptParameters::ImpulseResponsePath), nullptr);
+    }
+
+    /** Like loadPreset, for a snapshot from somewhere else, eg. the preset library. Message thread only */
+    void loadSnapshot(const ParameterSnapshot& snapshot) {
+        if (! presetMorph.push(PresetMorph::current, snapshot)) {
+            applySnapshot(getParameters(), snapshot);
+        }
+    }
+
+    /** Make the current settings the starting point for the morph, after they've been loaded some other way than
+     *  loadPreset. They're left as they are, wherever the Morph control is. Message thread only */
+    void setMorphStartToCurrentState() {
+        presetMorph.push(PresetMorph::current, presetManager.captureSnapshot(state), true);
+    }
+
+    /** Choose the preset at the far end of the Morph control. It's kept in the state, so it's saved with the session.
+     *  Message thread only */
+    void setMorphTarget(int index) {
+        auto snapshot = presetManager.createSnapshot(index, state);
+        if (! snapshot.empty()) {
+            presetMorph.push(PresetMorph::target, snapshot);
+            state.state.setProperty(Identifier(CryptParameters::MorphTarget),
+                                    presetManager.snapshotToString(snapshot, state), nullptr);
+        }
+    }
+
+    String getImpulseResponsePath() const {
+        return state.state.getProperty(Identifier(CryptParameters::ImpulseResponsePath)).toString();
+    }
+
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override {
         return (layouts.getMainOutputChannels() == 2);
     }
@@ -194,21 +481,52 @@ public:
      * AudioBuffer is passed around everywhere and only ever incremented
      */
     void processBlock (AudioBuffer<float>& audio, MidiBuffer& midi) override {
-        keyboardState.processNextMidiBuffer(midi, 0, audio.getNumSamples(), true);
+        // Filters, delay feedback and reverb all decay towards denormals in long tails
+        ScopedNoDenormals noDenormals;
+
+        mergedMidi.clear();
+        mergedMidi.addEvents(midi, 0, audio.getNumSamples(), 0);
+        midiQueue.popInto(mergedMidi, audio.getNumSamples());
+        midiQueue.mirrorHostNotes(midi);
+
+        presetMorph.process();
 
         audio.clear();
-        synth.renderNextBlock(audio, midi, 0, audio.getNumSamples());
+        auto factor = renderQuality.update(synth, isNonRealtime());
+        globalModulation.advance(audio.getNumSamples() * factor, getSampleRate() * factor);
+        renderQuality.render(synth, audio, mergedMidi);
         
         dsp::AudioBlock<float> block(audio);
         dsp::ProcessContextReplacing<float> context(block);
 
-        fxRig.process(context);
+        // Voices reset themselves if their filter blows up, but whatever they wrote this block is already mixed in
+        if (! isFinite(block)) {
+            audio.clear();
+            renderQuality.reset();
+            numericalFaults++;
+        }
+
+        setEcoStages();
+        fxRig.get<1>().setNonRealtime(isNonRealtime());
+
+        spectrum.write(audio);
+
+        processFxStage<0>(context);
+        processFxStage<1>(context);
+        processFxStage<2>(context);
 
+        // Master gain and the output meter in the one pass over the final output
         float masterDb = getParameterValue(CryptParameters::Master);
-        audio.applyGain(pow(10, masterDb/10));
+        auto peak = DspKernels::get().gainAndPeak(audio.getWritePointer(0), audio.getWritePointer(1),
+                                                  audio.getNumSamples(), (float) pow(10, masterDb/10));
+        // The meter can reset it to zero at any moment, so only ever replace what's there with something higher
+        auto previous = outputPeak.load(std::memory_order_relaxed);
+        while (peak > previous && ! outputPeak.compare_exchange_weak(previous, peak, std::memory_order_relaxed)) {}
 
-        // Buffer for waveform visualisation
-        oscBuffer.write(audio.getNumSamples(), audio.getReadPointer(0));
+        // Audition clips already have the FX and master gain on them, so they go on after everything else
+        previewPlayer.process(audio);
+
+        postFxTap.write(audio);
     }
 
     // We need to defer this implementation until the end of the file, when we have defined our editor
@@ -220,10 +538,11 @@ public:
     bool acceptsMidi() const override {return true;}
     bool producesMidi() const override {return false;}
     bool isMidiEffect() const override {return false;}
+    /** After the last note off the voices release, and then each FX stage that's in the chain rings out in turn */
     double getTailLengthSeconds() const override {
-        // note this is a total guess, probably should have
-        // done a real calculation
-        return 5.0;
+        auto release = getParameterValue(CryptParameters::Amplitude + "." + CryptParameters::Release);
+        auto tail = [](const auto& stage) { return stage.isAudible() ? stage.getTailLengthSeconds() : 0.0; };
+        return release + tail(fxRig.get<0>()) + tail(fxRig.get<1>()) + tail(fxRig.get<2>());
     }
 
     
@@ -237,19 +556,28 @@ public:
 
     // Save state to binary block (used eg. for saving state inside Ableton project)
     void getStateInformation (MemoryBlock& destData) override {
-        auto stateToSave = state.copyState();
-        std::unique_ptr<XmlElement> xml (stateToSave.createXml());
-        copyXmlToBinary(*xml, destData);
+        BinaryState::write(state, destData);
     }
 
-    // Restore state from binary block
+    // Restore state from binary block. Sessions from before the binary format have it as XML
     void setStateInformation (const void* data, int sizeInBytes) override {
-        std::unique_ptr<XmlElement> xmlState (getXmlFromBinary(data, sizeInBytes));
-        
-        if (xmlState != nullptr) {
-            if (xmlState->hasTagName(state.state.getType())) {
-                state.replaceState(ValueTree::fromXml(*xmlState));
+        // Whatever the morph was doing before belongs to the old state, so it's kept out of the way until the restored
+        // settings are its starting point
+        presetMorph.setSuspended(true);
+
+        if (! BinaryState::read(state, data, sizeInBytes)) {
+            std::unique_ptr<XmlElement> xmlState (getXmlFromBinary(data, sizeInBytes));
+
+            if (xmlState != nullptr) {
+                if (xmlState->hasTagName(state.state.getType())) {
+                    state.replaceState(ValueTree::fromXml(*xmlState));
+                }
             }
         }
+
+        setMorphStartToCurrentState();
+        auto target = state.state.getProperty(Identifier(CryptParameters::MorphTarget)).toString();
+        presetMorph.push(PresetMorph::target, presetManager.snapshotFromString(target, state), true);
+        presetMorph.setSuspended(false);
     }
 };
\ No newline at end of file
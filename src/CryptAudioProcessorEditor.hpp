@@ -18,34 +18,19 @@
 
 #include <JuceHeader.h>
 #include "CryptAudioProcessor.hpp"
+#include "PresetLibrary.hpp"
+#include "SharedResources.hpp"
+#include "FrameScheduler.hpp"
 
 const Colour CRYPT_BLUE = Colour::fromString("ff60a5ca");
 
-class EmbeddedFonts {
-private:
-    Font gothicaBook;
-
-public:
-    EmbeddedFonts() {
-        gothicaBook = Font(Typeface::createSystemTypefaceFor(BinaryData::GothicaBook_ttf, BinaryData::GothicaBook_ttfSize));
-    }
-    const Font& getGothicaBook() const {
-        return gothicaBook;
-    }
-};
-
-EmbeddedFonts& getFonts()
-{
-  static EmbeddedFonts fonts;
-  return fonts;
-}
-
-
 class CryptLookAndFeel: public LookAndFeel_V4 {
+    private:
+    SharedResourcePointer<EditorResources> resources;
+
     public:
     CryptLookAndFeel() {
         auto thumb = CRYPT_BLUE;
-        auto& fonts = getFonts();
         this->setColour(Slider::ColourIds::thumbColourId, thumb);
         this->setColour(Slider::ColourIds::trackColourId, Colours::orange);
         this->setColour(Slider::ColourIds::backgroundColourId, Colours::black);
@@ -63,7 +48,7 @@ class CryptLookAndFeel: public LookAndFeel_V4 {
         this->setColour(MidiKeyboardComponent::ColourIds::textLabelColourId, CRYPT_BLUE);
         this->setColour(MidiKeyboardComponent::ColourIds::shadowColourId, Colours::transparentWhite);
 
-        this->setDefaultSansSerifTypeface(fonts.getGothicaBook().getTypefacePtr());
+        this->setDefaultSansSerifTypeface(resources->getGothicaBookTypeface());
         
     }
 
@@ -155,7 +140,7 @@ class LabelledDial: public Component {
         slider(),
         attachment(state, parameterId, slider)
      {
-        auto& fonts = getFonts();
+        SharedResourcePointer<EditorResources> resources;
         slider.setSliderStyle(Slider::SliderStyle::RotaryHorizontalVerticalDrag);
         if (suffix.isNotEmpty()) {
             slider.setTextValueSuffix(suffix);
@@ -170,7 +155,7 @@ class LabelledDial: public Component {
             label.setText(labelText,NotificationType::dontSendNotification);
         }
         label.setJustificationType(Justification::centred);
-        label.setFont(fonts.getGothicaBook().withHeight(20));
+        label.setFont(resources->getGothicaBook().withHeight(20));
         addAndMakeVisible(slider);
         addAndMakeVisible(label);
     }
@@ -189,9 +174,12 @@ private:
     std::vector<std::unique_ptr<LabelledDial>> controls;
     Component* visualiser;
 
+    ToggleButton bypass;
+    std::unique_ptr<AudioProcessorValueTreeState::ButtonAttachment> bypassAttachment;
+
 public:
 
-    ControlGroup(StringRef title, AudioProcessorValueTreeState &state, std::list<StringRef> parameters, Component* visualiser = nullptr): title(title), state(state), visualiser(visualiser) {
+    ControlGroup(StringRef title, AudioProcessorValueTreeState &state, std::list<StringRef> parameters, Component* visualiser = nullptr, StringRef bypassParameter = ""): title(title), state(state), visualiser(visualiser) {
         for (auto param: parameters) {
             auto x = std::make_unique<LabelledDial>(state, param, CryptParameters::getLabel(param), CryptParameters::getUnit(param));
             addAndMakeVisible(*x);
@@ -200,11 +188,18 @@ public:
         if (visualiser) {
             addAndMakeVisible(*visualiser);
         }
+        if (bypassParameter.isNotEmpty()) {
+            bypass.setButtonText("Bypass");
+            bypassAttachment = std::make_unique<AudioProcessorValueTreeState::ButtonAttachment>(state, bypassParameter, bypass);
+            addAndMakeVisible(bypass);
+        }
         
         setText(title);
     }
 
     void resized() override {
+        bypass.setBounds(getLocalBounds().removeFromTop(20).removeFromRight(80).translated(-10, 0));
+
         auto contentsBounds = getLocalBounds().reduced(20);
         
         int width = contentsBounds.getWidth();
@@ -226,55 +221,110 @@ public:
     
 };
 
-class ADSREditor: public GroupComponent {
+/** A display of some parameters which is baked into an image and only drawn again when they've moved far enough to
+ *  make a visible difference. Parameter changes (which can come from automation on the audio thread) only mark it as
+ *  dirty, and the frame scheduler picks that up, so it's redrawn at most once a frame however fast they arrive.
+ *  Otherwise painting it is just drawing the image */
+class CachedLayerComponent: public Component, public AudioProcessorValueTreeState::Listener, private FrameScheduler::Client {
+    private:
+    AudioProcessorValueTreeState &state;
+    StringArray parameters;
 
-    class Viewer: public Component, public AudioProcessorValueTreeState::Listener, private AsyncUpdater {
-        private:
-        AudioProcessorValueTreeState &state;
-        String prefix;
-        String attackParam, decayParam, sustainParam, releaseParam;
+    Image layer;
+    float layerScale = 0.0f;
 
-        void handleAsyncUpdate() override {
+    void frameUpdate() override {
+        if (updateInputs()) {
+            layer = Image();
             repaint();
         }
+    }
 
-        public:
-        Viewer(String prefix, AudioProcessorValueTreeState &state)
-            :   prefix(prefix),
-                state(state),
-                attackParam(prefix + CryptParameters::Attack),
-                decayParam(prefix + CryptParameters::Decay),
-                sustainParam(prefix + CryptParameters::Sustain),
-                releaseParam(prefix + CryptParameters::Release) {
+    protected:
+    /** Reads the parameters, returns true if any of them has moved far enough from what's drawn to need a redraw */
+    virtual bool updateInputs() = 0;
+
+    /** Draws the whole display from scratch, from the values updateInputs() last took */
+    virtual void paintLayer(Graphics &g) = 0;
+
+    /** For updateInputs(). If the value has moved more than threshold from what's drawn, it becomes what's drawn */
+    static bool changedBeyond(float &drawn, float current, float threshold) {
+        if (std::abs(current - drawn) <= threshold) {
+            return false;
+        }
+        drawn = current;
+        return true;
+    }
 
-            state.addParameterListener(attackParam, this);
-            state.addParameterListener(decayParam, this);
-            state.addParameterListener(sustainParam, this);
-            state.addParameterListener(releaseParam, this);
+    float getValue(const String &parameterID) const {
+        return *state.getRawParameterValue(parameterID);
+    }
+
+    public:
+    CachedLayerComponent(AudioProcessorValueTreeState &state, FrameScheduler &scheduler, StringArray parameters)
+        : Client(scheduler, Client::whenDirty), state(state), parameters(parameters) {
+        for (auto& p: parameters) {
+            state.addParameterListener(p, this);
+        }
+    }
+
+    ~CachedLayerComponent() override {
+        for (auto& p: parameters) {
+            state.removeParameterListener(p, this);
         }
+    }
 
-        ~Viewer() {
-            state.removeParameterListener(attackParam, this);
-            state.removeParameterListener(decayParam, this);
-            state.removeParameterListener(sustainParam, this);
-            state.removeParameterListener(releaseParam, this);
+    void parameterChanged (const String& parameterID, float newValue) override {
+        markDirty();
+    }
+
+    void resized() override {
+        layer = Image();
+    }
+
+    void paint(Graphics &g) override {
+        auto scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+        if (! layer.isValid() || scale != layerScale) {
+            updateInputs();
+            auto width = roundToInt((float) getWidth() * scale);
+            auto height = roundToInt((float) getHeight() * scale);
+            if (width <= 0 || height <= 0) {
+                return;
+            }
+            layer = Image(Image::ARGB, width, height, true);
+            layerScale = scale;
+            Graphics layerGraphics(layer);
+            layerGraphics.addTransform(AffineTransform::scale(scale));
+            paintLayer(layerGraphics);
         }
+        g.drawImage(layer, getLocalBounds().toFloat());
+    }
+};
+
+class ADSREditor: public GroupComponent {
+
+    class Viewer: public CachedLayerComponent {
+        private:
+        String attackParam, decayParam, sustainParam, releaseParam;
+
+        float attack = NAN, decay = NAN, sustain = NAN, release = NAN;
 
-        void parameterChanged (const String& parameterID, float newValue) override {
-            triggerAsyncUpdate();
+        protected:
+        bool updateInputs() override {
+            // Small enough that the curve wouldn't move by a pixel
+            auto changed = changedBeyond(attack, getValue(attackParam), 0.001f);
+            changed = changedBeyond(decay, getValue(decayParam), 0.001f) || changed;
+            changed = changedBeyond(sustain, getValue(sustainParam), 0.002f) || changed;
+            changed = changedBeyond(release, getValue(releaseParam), 0.001f) || changed;
+            return changed;
         }
 
-        void paint (juce::Graphics& graphics) override {
+        void paintLayer (juce::Graphics& graphics) override {
             auto width = getWidth();
             auto height = getHeight();
 
             graphics.fillAll(Colours::black);
 
-            float attack = *state.getRawParameterValue(attackParam);
-            float decay =  *state.getRawParameterValue(decayParam);
-            float sustain = *state.getRawParameterValue(sustainParam);
-            float release = *state.getRawParameterValue(releaseParam);
-
             auto totalTime = attack + decay + release + 1.0;
             float xScale = (double) width / totalTime;
             float yScale = height-10;
@@ -312,6 +362,18 @@ class ADSREditor: public GroupComponent {
             graphics.strokePath(path, s);
 
         }
+
+        public:
+        Viewer(String prefix, AudioProcessorValueTreeState &state, FrameScheduler &scheduler)
+            :   CachedLayerComponent(state, scheduler, { prefix + CryptParameters::Attack, prefix + CryptParameters::Decay,
+                                              prefix + CryptParameters::Sustain, prefix + CryptParameters::Release }),
+                attackParam(prefix + CryptParameters::Attack),
+                decayParam(prefix + CryptParameters::Decay),
+                sustainParam(prefix + CryptParameters::Sustain),
+                releaseParam(prefix + CryptParameters::Release) {
+            // It fills its whole area, so repainting it doesn't mean drawing the background underneath
+            setOpaque(true);
+        }
     };
 
     private:
@@ -319,12 +381,12 @@ class ADSREditor: public GroupComponent {
     Viewer viewer;
 
     public:
-    ADSREditor(AudioProcessorValueTreeState& state, String prefix, StringRef title):
+    ADSREditor(AudioProcessorValueTreeState& state, FrameScheduler& scheduler, String prefix, StringRef title):
             a(state, prefix + CryptParameters::Attack, "A", CryptParameters::getUnit(CryptParameters::Attack)),
             d(state, prefix + CryptParameters::Decay, "D", CryptParameters::getUnit(CryptParameters::Decay)),
             s(state, prefix + CryptParameters::Sustain, "S", CryptParameters::getUnit(CryptParameters::Sustain)),
             r(state, prefix + CryptParameters::Release, "R", CryptParameters::getUnit(CryptParameters::Release)),
-            viewer(prefix, state) {
+            viewer(prefix, state, scheduler) {
 
         addAndMakeVisible(a);
         addAndMakeVisible(d);
@@ -349,46 +411,21 @@ class ADSREditor: public GroupComponent {
 };
 
 
-class DelayDisplay: public Component, public AudioProcessorValueTreeState::Listener, private AsyncUpdater {
+class DelayDisplay: public CachedLayerComponent {
     private:
-    float delayTime = 100.0f;
-    float delayMix = 0.3f;
-    float delayFeedback = 0.5;
-
-    AudioProcessorValueTreeState &state;
-
-    void handleAsyncUpdate() override
-    {
-        repaint();
-    }
+    float delayTime = NAN;
+    float delayMix = NAN;
+    float delayFeedback = NAN;
 
-    public:
-    DelayDisplay(AudioProcessorValueTreeState &state): state(state) {
-        state.addParameterListener(CryptParameters::DelayTime, this);
-        state.addParameterListener(CryptParameters::DelayFeedback, this);
-        state.addParameterListener(CryptParameters::DelayMix, this);
-        delayTime = *state.getRawParameterValue(CryptParameters::DelayTime);
-        delayFeedback =*state.getRawParameterValue(CryptParameters::DelayFeedback);
-        delayMix = *state.getRawParameterValue(CryptParameters::DelayMix);
-    }
-
-    ~DelayDisplay() {
-        state.removeParameterListener(CryptParameters::DelayTime, this);
-        state.removeParameterListener(CryptParameters::DelayFeedback, this);
-        state.removeParameterListener(CryptParameters::DelayMix, this);
+    protected:
+    bool updateInputs() override {
+        auto changed = changedBeyond(delayTime, getValue(CryptParameters::DelayTime), 1.0f);
+        changed = changedBeyond(delayFeedback, getValue(CryptParameters::DelayFeedback), 0.002f) || changed;
+        changed = changedBeyond(delayMix, getValue(CryptParameters::DelayMix), 0.005f) || changed;
+        return changed;
     }
 
-    void parameterChanged (const String& parameterID, float newValue) override {
-        if (parameterID == CryptParameters::DelayTime) {
-            delayTime = newValue;
-        } else if (parameterID == CryptParameters::DelayFeedback) {
-            delayFeedback = newValue;
-        } else if (parameterID == CryptParameters::DelayMix) {
-            delayMix = newValue;
-        } 
-        triggerAsyncUpdate();
-    }
-    void paint(Graphics &g) override {
+    void paintLayer(Graphics &g) override {
 
         Rectangle<int> bounds = getLocalBounds().reduced(10);
 
@@ -408,12 +445,19 @@ class DelayDisplay: public Component, public AudioProcessorValueTreeState::Liste
 
 
     }
+
+    public:
+    DelayDisplay(AudioProcessorValueTreeState &state, FrameScheduler &scheduler)
+        : CachedLayerComponent(state, scheduler, { CryptParameters::DelayTime, CryptParameters::DelayFeedback, CryptParameters::DelayMix }) {
+    }
 };
 
 // Oscillator visualiser in the oscillator section
-class OscDisplay: public Component, public AudioProcessorValueTreeState::Listener, private AsyncUpdater {
+class OscDisplay: public CachedLayerComponent {
     private:
-    AudioProcessorValueTreeState &state;
+    float shape = NAN;
+    float unison = NAN;
+    float spread = NAN;
 
     static inline float saw(float angle) {
         return (2.0f * angle/TAU) - 1;
@@ -427,36 +471,15 @@ class OscDisplay: public Component, public AudioProcessorValueTreeState::Listene
         return angle - static_cast<int>(angle / TAU) * TAU;
     }
 
-    void handleAsyncUpdate() override
-    {
-        repaint();
-    }
-
-    public:
-    OscDisplay(AudioProcessorValueTreeState &state): state(state) {
-        state.addParameterListener(CryptParameters::Shape, this);
-        state.addParameterListener(CryptParameters::Unison, this);
-        state.addParameterListener(CryptParameters::Spread, this);
-    }
-
-    ~OscDisplay() {
-        state.removeParameterListener(CryptParameters::Shape, this);
-        state.removeParameterListener(CryptParameters::Unison, this);
-        state.removeParameterListener(CryptParameters::Spread, this);
-    }
-
-    void parameterChanged (const String& parameterID, float newValue) override {
-
-        triggerAsyncUpdate();
+    protected:
+    bool updateInputs() override {
+        auto changed = changedBeyond(shape, getValue(CryptParameters::Shape), 0.005f);
+        changed = changedBeyond(unison, std::floor(getValue(CryptParameters::Unison)), 0.0f) || changed;
+        changed = changedBeyond(spread, getValue(CryptParameters::Spread), 0.001f) || changed;
+        return changed;
     }
-    void paint(Graphics &g) override {
-
-        float shape = *state.getRawParameterValue(CryptParameters::Shape);
-        int unison = static_cast<int>(*state.getRawParameterValue(CryptParameters::Unison));
-        float spread = *state.getRawParameterValue(CryptParameters::Spread);
-
-        DBG("shape = " << shape << " unison = " << unison << " spread = " << spread);
 
+    void paintLayer(Graphics &g) override {
         auto bounds = getLocalBounds();
         Path p;
         p.startNewSubPath(0,bounds.getHeight()/2);
@@ -469,8 +492,9 @@ class OscDisplay: public Component, public AudioProcessorValueTreeState::Listene
         }
 
         g.setColour(CRYPT_BLUE.withAlpha(0.5f));
-        for (auto i = 0 ; i < unison; i++) {
-            float vSpread = (((float)i / unison)* 2.0 - 1.0) * spread * 10;
+        auto voices = static_cast<int>(unison);
+        for (auto i = 0 ; i < voices; i++) {
+            float vSpread = (((float)i / voices)* 2.0 - 1.0) * spread * 10;
             float distance = vSpread * 30;
 
             auto transform = AffineTransform::translation(-getWidth()/2.0, 0).scaled((4.0 + vSpread)/4.0, 1.0).translated(getWidth()/2.0, distance);
@@ -478,77 +502,233 @@ class OscDisplay: public Component, public AudioProcessorValueTreeState::Listene
             g.strokePath(p, PathStrokeType(1), transform);
         }
     }
+
+    public:
+    OscDisplay(AudioProcessorValueTreeState &state, FrameScheduler &scheduler)
+        : CachedLayerComponent(state, scheduler, { CryptParameters::Shape, CryptParameters::Unison, CryptParameters::Spread }) {
+    }
 };
 
 // Waveform display running down the middle
-class WaveformDisplay: public Component, Timer {
+class WaveformDisplay: public Component, FrameScheduler::Client {
 private:
-    DrawableImage i;
-    Image img;
+    /** In the units of the 200px wide image this used to be drawn into, scaled to the actual width */
+    static constexpr float CORE_WIDTH = 2.0f;
+    static constexpr float GLOW_WIDTH = 6.0f;
+
     SharedBuffer & buffer;
+    bool consuming = false;
+
+    /** Horizontal extent of the trace and its glow on each row of pixels. Sized in resized(), so drawing a frame
+     *  doesn't allocate anything and costs the same however much data there is */
+    std::vector<Range<float>> trace;
+    std::vector<Range<float>> glow;
+    float widthScale = 1.0f;
+
     public:
 
-    WaveformDisplay(SharedBuffer & buffer): buffer(buffer), img(Image::PixelFormat::ARGB, 200,500,true) {
-        i.setImage(img);
-        
-        addAndMakeVisible(i);
-        startTimerHz(30);
+    WaveformDisplay(SharedBuffer & buffer, FrameScheduler & scheduler): Client(scheduler, Client::everyFrame), buffer(buffer) {
+        setInterceptsMouseClicks(false, false);
     }
-    
 
-    void resized() override {
-        i.setBounds(getLocalBounds());
-        i.setTransformToFit(getLocalBounds().toFloat(), RectanglePlacement::stretchToFit);
+    ~WaveformDisplay() override {
+        if (consuming) {
+            buffer.removeConsumer();
+        }
     }
 
-    void timerCallback() override {
+    /** The audio thread only fills the buffer while this is on screen */
+    void frameVisibilityChanged(bool isVisible) override {
+        if (isVisible != consuming) {
+            consuming = isVisible;
+            consuming ? buffer.addConsumer() : buffer.removeConsumer();
+        }
+    }
+
+    void resized() override {
+        trace.assign((size_t) jmax(0, getHeight()), {});
+        glow.assign(trace.size(), {});
+        widthScale = (float) getWidth() / 200.0f;
         update();
     }
 
+    void frameUpdate() override {
+        if (buffer.read() && update()) {
+            repaint();
+        }
+    }
+
     float taperFunction(float x) {
         return x < 0.5f ? cos((x - 0.5f) * TAU)/2 + 0.5f : 1.0f;
     }
 
-    void update() {
-        img.clear(img.getBounds(), Colours::transparentBlack);
-        Graphics g(i.getImage());
-        
-        buffer.read();
-        auto & displayBuffer = buffer.get();
-        
-        auto area = g.getClipBounds();
-        
-        Path waveformPath;
-        waveformPath.startNewSubPath(area.getCentreX(), 0);
+    /** Works out the spans for each row from the latest data, returns true if anything moved */
+    bool update() {
+        auto & frame = buffer.get();
+        auto rows = (int) trace.size();
+        auto numSamples = frame.getNumSamples();
+        if (rows == 0 || numSamples == 0) {
+            return false;
+        }
+        auto left = frame.getReadPointer(0);
+        auto right = frame.getReadPointer(1);
 
-        float max = 0.01f;
-        for (size_t i = 0; i < displayBuffer.size(); ++i) {
-            if (abs(displayBuffer[i]) > max) {
-                max = abs(displayBuffer[i]);
-            }
+        float max = 0.02f;
+        for (int i = 0; i < numSamples; i++) {
+            max = jmax(max, std::abs(left[i] + right[i]));
         }
-        
         float scaleFactor = 0.7f / max;
-        float dbSize = displayBuffer.size();
+        auto width = (float) getWidth();
+        auto xAt = [&] (int i) {
+            auto value = (left[i] + right[i]) * scaleFactor * taperFunction((float) i / (float) numSamples);
+            return jmap(value, -1.0f, 1.0f, width, 0.0f);
+        };
+
+        // Min and max of every sample in the row, plus the first of the next one so the trace stays joined up
+        auto core = CORE_WIDTH * widthScale / 2;
+        auto changed = false;
+        for (int y = 0; y < rows; y++) {
+            auto first = y * numSamples / rows;
+            auto last = jmin(numSamples - 1, (y + 1) * numSamples / rows);
+            auto lo = xAt(first);
+            auto hi = lo;
+            for (int i = first + 1; i <= last; i++) {
+                auto x = xAt(i);
+                lo = jmin(lo, x);
+                hi = jmax(hi, x);
+            }
+            Range<float> span { lo - core, hi + core };
+            changed = changed || span != trace[(size_t) y];
+            trace[(size_t) y] = span;
+        }
+        if (! changed) {
+            return false;
+        }
 
-        for (size_t i = 0; i < dbSize; ++i)
-        {
-            auto value = displayBuffer[i] * scaleFactor * taperFunction((float)i / dbSize);
-            auto x = jmap<float>(value, -1.0f, 1.0f, area.getRight(), area.getX());
-            auto y = jmap<float>(i, 0, displayBuffer.size(), 0, area.getHeight());
-            waveformPath.lineTo(x, y);
+        // The glow on each row covers the trace on the rows around it too, so it's one span per row and nothing gets
+        // blended twice
+        auto spread = (GLOW_WIDTH - CORE_WIDTH) * widthScale / 2;
+        auto reach = jmax(1, roundToInt(spread));
+        for (int y = 0; y < rows; y++) {
+            auto span = trace[(size_t) y];
+            for (int n = jmax(0, y - reach); n <= jmin(rows - 1, y + reach); n++) {
+                span = span.getUnionWith(trace[(size_t) n]);
+            }
+            glow[(size_t) y] = span.expanded(spread);
         }
-        g.setColour (CRYPT_BLUE.withAlpha(0.5f));
-        g.strokePath(waveformPath, PathStrokeType(6.0f));
+        return true;
+    }
 
-        g.setColour (Colours::white);
-        g.strokePath(waveformPath, PathStrokeType(2.0f));
-        
-        const MessageManagerLock mml;
-        if (mml.lockWasGained()) {
+    void paint(Graphics & g) override {
+        g.setColour(CRYPT_BLUE.withAlpha(0.5f));
+        for (size_t y = 0; y < glow.size(); y++) {
+            g.fillRect(glow[y].getStart(), (float) y, glow[y].getLength(), 1.0f);
+        }
+        g.setColour(Colours::white);
+        for (size_t y = 0; y < trace.size(); y++) {
+            g.fillRect(trace[y].getStart(), (float) y, trace[y].getLength(), 1.0f);
+        }
+    }
+};
+
+// Spectrum of the voices, under the waveform
+class SpectrumDisplay: public Component, FrameScheduler::Client {
+private:
+    static constexpr float MIN_HZ = 20.0f;
+    static constexpr float MAX_HZ = 20000.0f;
+    static constexpr float MIN_DB = -90.0f;
+    static constexpr float MAX_DB = 0.0f;
+
+    SpectrumAnalyser & analyser;
+    bool consuming = false;
+
+    /** The bins that fall in each column of pixels on the log frequency scale, for the current width and sample rate */
+    std::vector<Range<int>> columnBins;
+    double columnRate = 0.0;
+
+    /** Where the level and the held peak are drawn in each column */
+    std::vector<float> levelY;
+    std::vector<float> peakY;
+
+    void mapColumns(double sampleRate) {
+        columnRate = sampleRate;
+        auto width = (int) columnBins.size();
+        auto binHz = (float) sampleRate / SpectrumAnalyser::SIZE;
+        auto hzAt = [width] (int x) { return MIN_HZ * std::pow(MAX_HZ / MIN_HZ, (float) x / (float) width); };
+        for (int x = 0; x < width; x++) {
+            auto first = jlimit(1, SpectrumAnalyser::NUM_BINS - 1, (int) (hzAt(x) / binHz));
+            auto last = jlimit(first + 1, SpectrumAnalyser::NUM_BINS, (int) std::ceil(hzAt(x + 1) / binHz));
+            columnBins[(size_t) x] = { first, last };
+        }
+    }
+
+    float yFor(float db) const {
+        return jmap(jlimit(MIN_DB, MAX_DB, db), MIN_DB, MAX_DB, (float) getHeight(), 0.0f);
+    }
+
+public:
+    SpectrumDisplay(SpectrumAnalyser & analyser, FrameScheduler & scheduler): Client(scheduler, Client::everyFrame), analyser(analyser) {
+        setInterceptsMouseClicks(false, false);
+    }
+
+    ~SpectrumDisplay() override {
+        if (consuming) {
+            analyser.removeConsumer();
+        }
+    }
+
+    /** The analysis only runs while this is on screen */
+    void frameVisibilityChanged(bool isVisible) override {
+        if (isVisible != consuming) {
+            consuming = isVisible;
+            consuming ? analyser.addConsumer() : analyser.removeConsumer();
+        }
+    }
+
+    void resized() override {
+        auto width = (size_t) jmax(0, getWidth());
+        columnBins.assign(width, {});
+        levelY.assign(width, (float) getHeight());
+        peakY.assign(width, (float) getHeight());
+        columnRate = 0.0;
+    }
+
+    void frameUpdate() override {
+        if (analyser.read()) {
+            update();
             repaint();
         }
     }
+
+    /** The loudest bin in each column, so narrow peaks don't vanish between pixels */
+    void update() {
+        auto & frame = analyser.get();
+        if (frame.sampleRate != columnRate) {
+            mapColumns(frame.sampleRate);
+        }
+        for (size_t x = 0; x < columnBins.size(); x++) {
+            auto level = MIN_DB;
+            auto peak = MIN_DB;
+            for (auto bin = columnBins[x].getStart(); bin < columnBins[x].getEnd(); bin++) {
+                level = jmax(level, frame.levels[(size_t) bin]);
+                peak = jmax(peak, frame.peaks[(size_t) bin]);
+            }
+            levelY[x] = yFor(level);
+            peakY[x] = yFor(peak);
+        }
+    }
+
+    void paint(Graphics & g) override {
+        auto height = (float) getHeight();
+        g.setColour(CRYPT_BLUE.withAlpha(0.4f));
+        for (size_t x = 0; x < levelY.size(); x++) {
+            g.fillRect((float) x, levelY[x], 1.0f, height - levelY[x]);
+        }
+        g.setColour(Colours::white.withAlpha(0.8f));
+        for (size_t x = 0; x < peakY.size(); x++) {
+            g.fillRect((float) x, peakY[x], 1.0f, 1.0f);
+        }
+    }
 };
 
 class KeyboardToggleButton: public Button {
@@ -567,7 +747,7 @@ class KeyboardToggleButton: public Button {
     }
 
     public:
-    KeyboardToggleButton(): Button("Key"), keyboardIcon(ImageCache::getFromMemory(BinaryData::keyboardicon_png, BinaryData::keyboardicon_pngSize)) {
+    KeyboardToggleButton(): Button("Key"), keyboardIcon(SharedResourcePointer<EditorResources>()->getKeyboardIcon()) {
     }
 
     void setEnabled(bool enabled) {
@@ -578,10 +758,35 @@ class KeyboardToggleButton: public Button {
 
 };
 
-class CryptKeyboardComponent: public MidiKeyboardComponent {
+class CryptKeyboardComponent: public MidiKeyboardComponent, FrameScheduler::Client {
+    private:
+    MidiKeyboardState& keyboardState;
+    MidiInjectionQueue& midiQueue;
+    bool mirroring = false;
+
     public:
 
-    CryptKeyboardComponent(MidiKeyboardState &state): MidiKeyboardComponent(state, MidiKeyboardComponent::horizontalKeyboard) {}
+    /** Also shows the notes the host is playing, for as long as the editor is showing */
+    CryptKeyboardComponent(MidiKeyboardState &state, MidiInjectionQueue &queue, FrameScheduler &scheduler):
+            MidiKeyboardComponent(state, MidiKeyboardComponent::horizontalKeyboard), Client(scheduler, Client::everyFrame),
+            keyboardState(state), midiQueue(queue) {}
+
+    ~CryptKeyboardComponent() override {
+        if (mirroring) {
+            midiQueue.setMirroring(keyboardState, false);
+        }
+    }
+
+    void frameVisibilityChanged(bool isVisible) override {
+        if (isVisible != mirroring) {
+            mirroring = isVisible;
+            midiQueue.setMirroring(keyboardState, mirroring);
+        }
+    }
+
+    void frameUpdate() override {
+        midiQueue.updateKeyboard(keyboardState);
+    }
 
     void drawBlackNote (int /*midiNoteNumber*/, Graphics& g, Rectangle<float> area,
                                             bool isDown, bool isOver, Colour noteFillColour) override {
@@ -607,17 +812,175 @@ class CryptKeyboardComponent: public MidiKeyboardComponent {
 };
 
 
+/** Lists the presets in the library, filtered by name or tag. A single click plays the preset's audition clip, and a
+ *  double click (or return) loads it. Everything comes from the library's index, so nothing here touches the disk */
+class PresetBrowser: public Component, private ListBoxModel, private ChangeListener, private TextEditor::Listener {
+    private:
+    PresetLibrary& library;
+    PreviewPlayer& player;
+
+    TextEditor search;
+    ListBox list;
+    TextButton fromFile;
+
+    std::shared_ptr<const LibraryIndex> index;
+    /** Indexes into index of the presets which match the search */
+    std::vector<size_t> visible;
+
+    void refresh() {
+        index = library.getIndex();
+        auto terms = StringArray::fromTokens(search.getText(), true);
+        visible.clear();
+        for (size_t i = 0; i < index->size(); i++) {
+            auto& preset = (*index)[i];
+            auto matches = std::all_of(terms.begin(), terms.end(), [&preset] (const String& term) {
+                return preset.name.containsIgnoreCase(term)
+                    || std::any_of(preset.tags.begin(), preset.tags.end(), [&term] (const String& tag) {
+                        return tag.containsIgnoreCase(term);
+                    });
+            });
+            if (matches) {
+                visible.push_back(i);
+            }
+        }
+        list.updateContent();
+        repaint();
+    }
+
+    const LibraryPreset* getPreset(int row) const {
+        return isPositiveAndBelow(row, (int) visible.size()) ? &(*index)[visible[(size_t) row]] : nullptr;
+    }
+
+    void load(int row) {
+        if (auto* preset = getPreset(row)) {
+            player.stop();
+            if (onLoad) {
+                onLoad(*preset);
+            }
+            dismiss();
+        }
+    }
+
+    /** When shown in a CallOutBox, which is the usual way */
+    void dismiss() {
+        if (auto* box = findParentComponentOfClass<CallOutBox>()) {
+            box->dismiss();
+        }
+    }
+
+    int getNumRows() override {
+        return (int) visible.size();
+    }
+
+    void paintListBoxItem(int row, Graphics& g, int width, int height, bool rowIsSelected) override {
+        auto* preset = getPreset(row);
+        if (preset == nullptr) {
+            return;
+        }
+        if (rowIsSelected) {
+            g.fillAll(CRYPT_BLUE.withAlpha(0.3f));
+        }
+        auto area = Rectangle<int>(0, 0, width, height).reduced(6, 0);
+        g.setFont((float) height * 0.6f);
+        g.setColour(CRYPT_BLUE.withAlpha(preset->preview != File() ? 1.0f : 0.6f));
+        g.drawText(preset->name, area, Justification::centredLeft, true);
+        g.setColour(Colours::grey);
+        g.drawText(preset->tags.joinIntoString(", "), area, Justification::centredRight, true);
+    }
+
+    void listBoxItemClicked(int row, const MouseEvent&) override {
+        if (auto* preset = getPreset(row)) {
+            if (preset->preview != File()) {
+                player.play(preset->preview);
+            }
+        }
+    }
+
+    void listBoxItemDoubleClicked(int row, const MouseEvent&) override {
+        load(row);
+    }
+
+    void returnKeyPressed(int lastRowSelected) override {
+        load(lastRowSelected);
+    }
+
+    void changeListenerCallback(ChangeBroadcaster*) override {
+        refresh();
+    }
+
+    void textEditorTextChanged(TextEditor&) override {
+        refresh();
+    }
+
+    public:
+    std::function<void(const LibraryPreset&)> onLoad;
+    std::function<void()> onOpenFile;
+
+    PresetBrowser(PresetLibrary& library, PreviewPlayer& player): library(library), player(player) {
+        search.setTextToShowWhenEmpty("search names and tags", Colours::grey);
+        search.addListener(this);
+        addAndMakeVisible(search);
+
+        list.setModel(this);
+        list.setRowHeight(24);
+        list.setColour(ListBox::backgroundColourId, Colours::black.withAlpha(0.6f));
+        addAndMakeVisible(list);
+
+        fromFile.setButtonText("From file...");
+        fromFile.onClick = [this] {
+            if (onOpenFile) {
+                onOpenFile();
+            }
+            dismiss();
+        };
+        addAndMakeVisible(fromFile);
+
+        library.addChangeListener(this);
+        refresh();
+        // Shows what's in the index straight away, and whatever's changed on disk as soon as the scan finds it
+        library.rescan();
+    }
+
+    ~PresetBrowser() override {
+        library.removeChangeListener(this);
+        player.stop();
+    }
+
+    void paintOverChildren(Graphics& g) override {
+        if (visible.empty()) {
+            g.setColour(Colours::grey);
+            g.drawFittedText(index->empty() ? "No presets yet - saved presets go in " + library.getFolder().getFullPathName()
+                                            : "Nothing matches",
+                             list.getBounds().reduced(10), Justification::centred, 4);
+        }
+    }
+
+    void resized() override {
+        auto area = getLocalBounds();
+        search.setBounds(area.removeFromTop(28).reduced(2));
+        fromFile.setBounds(area.removeFromBottom(30).reduced(2));
+        list.setBounds(area.reduced(2));
+    }
+};
+
 /** GUI for the plugin */
 class CryptAudioProcessorEditor: public AudioProcessorEditor, public Button::Listener, public ComboBox::Listener {
 private:
-    // Must come first so it's destroyed last
+    /** Fonts and images shared with every other open editor */
+    SharedResourcePointer<EditorResources> resources;
+
+    // Must come first (after the resources it uses) so it's destroyed last
     CryptLookAndFeel lookAndFeel;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CryptAudioProcessorEditor)
 
     CryptAudioProcessor & processor;
 
+    /** Before all the displays, which register with it */
+    FrameScheduler frameScheduler { *this };
+
     WaveformDisplay visualiser;
+    SpectrumDisplay spectrumDisplay;
 
     CryptKeyboardComponent keyboard;
     OscDisplay oscDisplay;
@@ -628,8 +991,13 @@ private:
     Label pluginTitle;
 
     ComboBox presets;
+    /** Menu IDs above this pick the morph target rather than loading a preset */
+    static constexpr int MORPH_TARGET_OFFSET = 100;
+    /** Menu ID of the loaded preset, 0 if it came from a file */
+    int currentPreset = 0;
     TextButton save;
     TextButton load;
+    TextButton impulseResponse;
 
     HyperlinkButton bowchurch;
     HyperlinkButton vitling;
@@ -645,6 +1013,8 @@ private:
 
     std::unique_ptr<FileChooser> fileChooser;
 
+    SharedResourcePointer<PresetLibrary> library;
+
     Label versionNumber;
 
 public:
@@ -653,25 +1023,27 @@ public:
     explicit CryptAudioProcessorEditor(CryptAudioProcessor &processor):
             AudioProcessorEditor(processor),
             processor(processor),
-            keyboard(processor.keyboardState),
-            visualiser(processor.oscBuffer),
-            ampEnv(processor.state, CryptParameters::Amplitude + ".", "Amp Env"),
-            filterEnv(processor.state, CryptParameters::Filter + ".", "Filter Env"),
-            oscDisplay(processor.state),
-            delayDisplay(processor.state),
+            keyboard(processor.keyboardState, processor.midiQueue, frameScheduler),
+            visualiser(processor.postFxTap, frameScheduler),
+            spectrumDisplay(processor.spectrum, frameScheduler),
+            ampEnv(processor.state, frameScheduler, CryptParameters::Amplitude + ".", "Amp Env"),
+            filterEnv(processor.state, frameScheduler, CryptParameters::Filter + ".", "Filter Env"),
+            oscDisplay(processor.state, frameScheduler),
+            delayDisplay(processor.state, frameScheduler),
             osc("Oscillator", processor.state, {CryptParameters::Unison, CryptParameters::Spread, CryptParameters::Shape}, &oscDisplay),
             filter("Filter", processor.state, {CryptParameters::Cutoff, CryptParameters::Resonance, CryptParameters::FilterEnv}),
-            phaser("Phaser", processor.state, {CryptParameters::PhaserDepth, CryptParameters::PhaserRate, CryptParameters::PhaserMix}),
-            delay("Delay", processor.state, {CryptParameters::DelayTime, CryptParameters::DelayFeedback, CryptParameters::DelayMix}, &delayDisplay),
-            theVoid("Void", processor.state, {CryptParameters::Dirt, CryptParameters::Space}),
-            global("Globals", processor.state, {CryptParameters::PitchBendRange, CryptParameters::Master}),
+            phaser("Phaser", processor.state, {CryptParameters::PhaserDepth, CryptParameters::PhaserRate, CryptParameters::PhaserMix}, nullptr, CryptParameters::PhaserBypass),
+            delay("Delay", processor.state, {CryptParameters::DelayTime, CryptParameters::DelayFeedback, CryptParameters::DelayMix}, &delayDisplay, CryptParameters::DelayBypass),
+            theVoid("Void", processor.state, {CryptParameters::Dirt, CryptParameters::Space, CryptParameters::ReverbMode}, nullptr, CryptParameters::ReverbBypass),
+            global("Globals", processor.state, {CryptParameters::PitchBendRange, CryptParameters::Morph, CryptParameters::Master}),
             tooltipWindow(this) {
 
         setLookAndFeel(&lookAndFeel);
-        auto& fonts = getFonts();
+        // The background covers everything, so nothing behind the editor has to be drawn when part of it repaints
+        setOpaque(true);
 
         pluginTitle.setText("CRYPT",NotificationType::dontSendNotification);
-        pluginTitle.setFont(fonts.getGothicaBook().withHeight(40));
+        pluginTitle.setFont(resources->getGothicaBook().withHeight(40));
         pluginTitle.setJustificationType(Justification::horizontallyCentred);
 
         setSize(1000,625);
@@ -689,12 +1061,18 @@ public:
         addAndMakeVisible(global);
         addAndMakeVisible(pluginTitle);
         addAndMakeVisible(visualiser);
+        addAndMakeVisible(spectrumDisplay);
 
         auto presetNames = processor.presetManager.listPresets();
+        PopupMenu morphTargets;
         int n = 1;
         for (auto presetName: presetNames) {
-            presets.addItem(presetName, n++);
+            presets.addItem(presetName, n);
+            morphTargets.addItem(MORPH_TARGET_OFFSET + n, presetName);
+            n++;
         }
+        presets.addSeparator();
+        presets.getRootMenu()->addSubMenu("Morph target", morphTargets);
 
         presets.addListener(this);
         addAndMakeVisible(presets);
@@ -708,9 +1086,9 @@ public:
         vitling.setURL(URL{"https://www.vitling.xyz/ext/crypt/vitling"});
         donate.setURL(URL{"https://www.vitling.xyz/ext/crypt/donate"});
         
-        bowchurch.setFont(fonts.getGothicaBook().withHeight(24.0f), false);
-        vitling.setFont(fonts.getGothicaBook().withHeight(24.0f), false);
-        donate.setFont(fonts.getGothicaBook().withHeight(24.0f), false);
+        bowchurch.setFont(resources->getGothicaBook().withHeight(24.0f), false);
+        vitling.setFont(resources->getGothicaBook().withHeight(24.0f), false);
+        donate.setFont(resources->getGothicaBook().withHeight(24.0f), false);
         bowchurch.setTooltip("");
         vitling.setTooltip("");
 
@@ -729,6 +1107,11 @@ public:
         save.addListener(this);
         load.addListener(this);
 
+        impulseResponse.setButtonText("IR");
+        impulseResponse.setTooltip(getImpulseResponseTooltip());
+        impulseResponse.addListener(this);
+        addAndMakeVisible(impulseResponse);
+
         keyboardButton.addListener(this);
         
         addAndMakeVisible(keyboardButton);
@@ -751,7 +1134,9 @@ public:
         if (button == &save) {
             openSaveDialog();
         } else if (button == &load) {
-            openLoadDialog();
+            openPresetBrowser();
+        } else if (button == &impulseResponse) {
+            openImpulseResponseDialog();
         } else if (button == &keyboardButton) {
             keyboardIsVisible = !keyboardIsVisible;
             if (keyboardIsVisible) {
@@ -765,28 +1150,65 @@ public:
         }
     };
 
+    String getImpulseResponseTooltip() const {
+        auto path = processor.getImpulseResponsePath();
+        return path.isEmpty() ? "Load an impulse response for the Void's convolution mode"
+                              : "Impulse response: " + File(path).getFileName();
+    }
+
+    void openImpulseResponseDialog() {
+        fileChooser = std::make_unique<FileChooser>("Load impulse response", File::getSpecialLocation(File::userHomeDirectory), "*.wav;*.aif;*.aiff;*.flac");
+        auto flags = FileBrowserComponent::openMode | FileBrowserComponent::canSelectFiles;
+        fileChooser->launchAsync(flags, [this] (const FileChooser& chooser) {
+            File file (chooser.getResult());
+            if (file.existsAsFile()) {
+                processor.setImpulseResponse(file);
+                impulseResponse.setTooltip(getImpulseResponseTooltip());
+            }
+        });
+    }
+
+    void openPresetBrowser() {
+        auto browser = std::make_unique<PresetBrowser>(*library, processor.previewPlayer);
+        browser->onLoad = [this] (const LibraryPreset& preset) {
+            loadLibraryPreset(preset);
+        };
+        browser->onOpenFile = [this] {
+            openLoadDialog();
+        };
+        browser->setSize(320, 420);
+        CallOutBox::launchAsynchronously(std::move(browser), load.getBounds(), this);
+    }
+
+    void loadLibraryPreset(const LibraryPreset& preset) {
+        processor.loadSnapshot(preset.toSnapshot(processor.state));
+        if (preset.impulseResponsePath.isEmpty()) {
+            processor.state.state.removeProperty(Identifier(CryptParameters::ImpulseResponsePath), nullptr);
+        } else {
+            processor.state.state.setProperty(Identifier(CryptParameters::ImpulseResponsePath), preset.impulseResponsePath, nullptr);
+        }
+        impulseResponse.setTooltip(getImpulseResponseTooltip());
+        currentPreset = 0;
+        presets.setSelectedId(0, NotificationType::dontSendNotification);
+        presets.setTextWhenNothingSelected(preset.name);
+    }
+
     void openLoadDialog() {
-        fileChooser = std::make_unique<FileChooser>("Load preset", File::getSpecialLocation(File::userHomeDirectory), "*.crypt");
+        fileChooser = std::make_unique<FileChooser>("Load preset", library->getFolder(), "*.crypt");
         auto flags = FileBrowserComponent::openMode | FileBrowserComponent::canSelectFiles;
         fileChooser->launchAsync(flags, [this] (const FileChooser& chooser) {
             File file (chooser.getResult());
             if (file.getFileName().isEmpty()) {
                 DBG("No file selected");
-            } else {
-                auto result = XmlDocument::parse(file);
-                if (result != nullptr) {
-                    if (result->hasTagName(processor.state.state.getType())) {
-                        processor.state.replaceState(ValueTree::fromXml(*result));
-                        presets.setSelectedId(0, NotificationType::dontSendNotification);
-                        presets.setTextWhenNothingSelected(file.getFileName());
-                    }
-                }
+            } else if (auto preset = PresetLibrary::parse(file, file.getParentDirectory())) {
+                // The same as picking it from the library, so the audio thread switches over to it in one go
+                loadLibraryPreset(*preset);
             }
         });
     }
 
     void openSaveDialog() {
-        fileChooser = std::make_unique<FileChooser>("Save preset", File::getSpecialLocation(File::userHomeDirectory), "*.crypt");
+        fileChooser = std::make_unique<FileChooser>("Save preset", library->getFolder(), "*.crypt");
         auto flags = FileBrowserComponent::saveMode;
         
         fileChooser->launchAsync(flags, [this] (const FileChooser& chooser) {
@@ -798,6 +1220,8 @@ public:
                 auto currentState = processor.state.copyState();
                 std::unique_ptr<XmlElement> xml (currentState.createXml());
                 xml->writeTo(file);
+                library->rescan();
+                currentPreset = 0;
                 presets.setSelectedId(0, NotificationType::dontSendNotification);
                 presets.setTextWhenNothingSelected(file.getFileName());
             }
@@ -805,7 +1229,15 @@ public:
     }
 
     void comboBoxChanged (ComboBox* comboBoxThatHasChanged) override {
-        processor.presetManager.applyPreset(comboBoxThatHasChanged->getSelectedId(), processor.state);
+        auto id = comboBoxThatHasChanged->getSelectedId();
+        if (id > MORPH_TARGET_OFFSET) {
+            // Picking a target doesn't change what's loaded, so the box goes back to showing that
+            processor.setMorphTarget(id - MORPH_TARGET_OFFSET);
+            comboBoxThatHasChanged->setSelectedId(currentPreset, NotificationType::dontSendNotification);
+        } else if (id > 0) {
+            currentPreset = id;
+            processor.loadPreset(id);
+        }
     }
 
     void resized() override {
@@ -837,7 +1269,9 @@ public:
         auto leftBounds = totalBounds.removeFromLeft(400);
         auto rightBounds = totalBounds.removeFromRight(400);
 
+        auto spectrumBounds = totalBounds.removeFromBottom(125);
         visualiser.setBounds(totalBounds.withTrimmedTop(-8));
+        spectrumDisplay.setBounds(spectrumBounds.reduced(10));
 
         // I know it seems a bit silly to use StretchableLayoutManagers for each side when they don't actually stretch,
         // but I started with the idea of making it more responsive and only decided to fix it later, and this is working
@@ -861,6 +1295,8 @@ public:
         rightLayout.setItemLayout(2, 125,125,125);
         rightLayout.setItemLayout(3, 125,125,125);
         rightLayout.layOutComponents(rightComponents, 4, rightBounds.getX(), rightBounds.getY(), rightBounds.getWidth(), rightBounds.getHeight(), true, true);
+        theVoid.setBounds(theVoid.getBounds().withTrimmedRight(50));
+        impulseResponse.setBounds({theVoid.getRight() + 5, theVoid.getY() + 40, 40, 30});
         global.setBounds(global.getBounds().withTrimmedRight(50));
         keyboardButton.setBounds({global.getRight(), global.getY() + 30, 50, 50});
         versionNumber.setBounds({global.getRight(), global.getY()+90, 50, 20});
@@ -868,7 +1304,8 @@ public:
 
 
     void paint (juce::Graphics& graphics) override {
-        auto image = ImageCache::getFromMemory(BinaryData::bg_jpg, BinaryData::bg_jpgSize);
-        graphics.drawImageWithin(image, 0, 0, getWidth(), getHeight(), RectanglePlacement::fillDestination);
+        // Only the part under whatever needs repainting gets copied
+        auto scale = graphics.getInternalContext().getPhysicalPixelScaleFactor();
+        graphics.drawImage(resources->getBackground(getWidth(), getHeight(), scale), getLocalBounds().toFloat());
     }
 };
\ No newline at end of file
@@ -32,12 +32,16 @@ namespace CryptParameters {
     const String DelayTime = "DelayTime";
     const String DelayMix = "DelayMix";
     const String DelayFeedback = "DelayFeedback";
+    const String DelayBypass = "DelayBypass";
 
     const String PhaserDepth = "PhaserDepth";
     const String PhaserRate = "PhaserRate";
     const String PhaserMix = "PhaserMix";
+    const String PhaserBypass = "PhaserBypass";
 
     const String Space = "Space";
+    const String ReverbMode = "ReverbMode";
+    const String ReverbBypass = "ReverbBypass";
 
     const String Attack = "Attack";
     const String Decay = "Decay";
@@ -46,10 +50,23 @@ namespace CryptParameters {
 
     const String PitchBendRange = "PitchBendRange";
     const String Master = "Master";
+    const String Morph = "Morph";
+
+    const String OfflineQuality = "OfflineQuality";
+    const String EcoMode = "EcoMode";
+
+    const String LfoRate = "Rate";
+    const String Width = "Width";
 
     // ID prefixes
     const String Amplitude = "Amplitude";
     const String Filter = "Filter";
+    const String VoiceLfo = "VoiceLfo";
+    const String GlobalLfo = "GlobalLfo";
+
+    // Properties of the state tree which aren't parameters
+    const String ImpulseResponsePath = "ImpulseResponsePath";
+    const String MorphTarget = "MorphTarget";
     
 
     std::map<String, String> unitMap {
@@ -71,7 +88,8 @@ namespace CryptParameters {
         {PhaserRate, "Rate"},
         {PhaserMix, "Mix"},
         {FilterEnv, "Env Amount"},
-        {PitchBendRange, "PB Range"}
+        {PitchBendRange, "PB Range"},
+        {ReverbMode, "Mode"}
     };
 
     StringRef getUnit(StringRef param) {
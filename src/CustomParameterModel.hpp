@@ -26,13 +26,41 @@ struct ParameterSpec {
     String label;
     NormalisableRange<float> range;
     float def;
+    /* Stepped settings (eg. quality modes) can name each step, which is what the host and the UI will show */
+    StringArray choices = {};
 };
 
+/* These are AudioProcessorValueTreeState::Parameters rather than plain AudioParameterFloats so that setValue() on
+   its own reaches the components listening to them, without telling the host (see PresetMorph) */
 std::unique_ptr<AudioProcessorParameterGroup> createParameterGroup(String groupId, String groupName, std::vector<ParameterSpec> params) {
     auto group = std::make_unique<AudioProcessorParameterGroup>(groupId, groupName, "|");
     for (auto p : params) {
-        group->addChild(std::make_unique<AudioParameterFloat>(ParameterID {p.id,1 }, p.name, p.range, p.def));
+        AudioProcessorValueTreeStateParameterAttributes attributes;
+        if (! p.choices.isEmpty()) {
+            auto start = p.range.start;
+            attributes = attributes
+                .withStringFromValueFunction([choices = p.choices, start](float value, int) {
+                    return choices[roundToInt(value - start)];
+                })
+                .withValueFromStringFunction([choices = p.choices, start](const String& text) {
+                    return start + (float) jmax(0, choices.indexOf(text, true));
+                });
+        }
+        group->addChild(std::make_unique<AudioProcessorValueTreeState::Parameter>(ParameterID {p.id,1 }, p.name, p.range, p.def, attributes));
     }
 
     return std::move(group);
-}
\ No newline at end of file
+}
+
+/* Components listen for their own parameters. Since they might start listening after the state has been restored
+   (eg. the voices, which are only created in prepareToPlay), each one is told the current values straight away
+   rather than waiting for the next change */
+inline void listenToParams(AudioProcessorValueTreeState& state, const std::vector<ParameterSpec>& params,
+                           AudioProcessorValueTreeState::Listener* listener) {
+    for (auto& p : params) {
+        state.addParameterListener(p.id, listener);
+        if (auto* value = state.getRawParameterValue(p.id)) {
+            listener->parameterChanged(p.id, value->load());
+        }
+    }
+}
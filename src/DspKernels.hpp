@@ -0,0 +1,367 @@
+/*
+    Copyright 2025 David Whiting
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <JuceHeader.h>
+
+/** The hot inner loops of the synth, written as plain loops over arrays so that the compiler can vectorise them.
+ *
+ *  On x86 with GCC/Clang each kernel is compiled several times over for different instruction sets, and the widest
+ *  one the CPU supports is picked at runtime - so one binary uses AVX-512 on a render server and still runs on an old
+ *  SSE2 machine. Everywhere else (MSVC, ARM) there is just the one generic build.
+ *
+ *  For benchmarking and debugging, the CRYPT_FORCE_ISA environment variable (generic, avx2 or avx512) or forceIsa()
+ *  pins a particular set. Asking for something the CPU can't do falls back to the best set it can.
+ */
+namespace DspKernels {
+
+#if (JUCE_GCC || JUCE_CLANG) && JUCE_INTEL
+ #define CRYPT_KERNEL_MULTIVERSIONING 1
+#else
+ #define CRYPT_KERNEL_MULTIVERSIONING 0
+#endif
+
+    enum class Isa { generic, avx2, avx512 };
+
+    /** Width of the feedback delay network in the reverb, chosen so that one sample of every line fits in a register */
+    constexpr int FDN_LINES = 8;
+
+    /** Number of allpass stages in the phaser */
+    constexpr int PHASER_STAGES = 6;
+
+    struct KernelSet {
+        /** Adds one unison saw/square oscillator to outL/outR, returns its angle at the end of the run */
+        float (*unisonSaw)(float* outL, float* outR, int numSamples, float angle, float increment,
+                           float leftGain, float rightGain, float shape) noexcept;
+
+        /** TPT state variable lowpass over both channels in place, with a per-sample g = tan(pi * fc / fs).
+         *  state holds s1, s2 for left then s1, s2 for right */
+        void (*svfLowpassStereo)(float* left, float* right, int numSamples, const float* g, float R2,
+                                 float* state) noexcept;
+
+        /** Cubic soft-clip driven by dirt, then mixed into the output with a per-sample gain */
+        void (*shapeAndMix)(float* outL, float* outR, const float* inL, const float* inR, const float* gain,
+                            int numSamples, float dirt) noexcept;
+
+        /** out = in + wet * delayed, feedback = in + fb * delayed. out may be the same buffer as in */
+        void (*delayFeedbackMix)(float* out, float* feedback, const float* in, const float* delayed,
+                                 int numSamples, float wet, float fb) noexcept;
+
+        /** The feedback path of the FDN reverb, in place on FDN_LINES interleaved lanes per sample: one-pole damping
+         *  (state holds one value per line), a decay gain per line, then a normalised Hadamard mix */
+        void (*fdnFeedback)(float* lanes, int numSamples, const float* gains, float damping, float* state) noexcept;
+
+        /** PHASER_STAGES first-order TPT allpasses in series on both channels at once, with left and right as two lanes
+         *  sharing a per-sample G = g / (1 + g), then mixed back with the dry signal in place. state holds the stages
+         *  in order, left and right side by side */
+        void (*phaserStereo)(float* left, float* right, int numSamples, const float* G, float dryGain, float wetGain,
+                             float* state) noexcept;
+
+        /** Applies a gain to both channels in place and returns the peak absolute value of the result */
+        float (*gainAndPeak)(float* left, float* right, int numSamples, float gain) noexcept;
+    };
+
+    // The clamps below only vectorise if the compiler may assume nothing traps on floating point exceptions, which
+    // nothing here relies on. Clang assumes that already; for GCC it's switched on just for the kernels, and since GCC
+    // won't inline across differing options, they use their own min/max/abs rather than the std:: ones
+   #if JUCE_GCC
+    #pragma GCC push_options
+    #pragma GCC optimize ("no-trapping-math")
+   #endif
+
+    namespace detail {
+        constexpr float TAU = MathConstants<float>::twoPi;
+        constexpr float INV_TAU = 1.0f / MathConstants<float>::twoPi;
+
+        /** Angles are always positive, so truncating is a floor that vectorises even on plain SSE2 */
+        forcedinline float wrapAngle(float angle) noexcept {
+            return angle - TAU * (float) (int) (angle * INV_TAU);
+        }
+
+        forcedinline float minimum(float a, float b) noexcept { return b < a ? b : a; }
+        forcedinline float maximum(float a, float b) noexcept { return a < b ? b : a; }
+        forcedinline float clamp(float x) noexcept { return minimum(maximum(x, -1.0f), 1.0f); }
+        forcedinline float magnitude(float x) noexcept { return x < 0.0f ? -x : x; }
+
+        /** m with the sign of s, like std::copysign for a positive m */
+        forcedinline float withSignOf(float m, float s) noexcept { return s < 0.0f ? -m : m; }
+
+        forcedinline void copy(const float* source, int count, float* destination) noexcept {
+            for (int i = 0; i < count; i++) {
+                destination[i] = source[i];
+            }
+        }
+
+        forcedinline float unisonSaw(float* __restrict outL, float* __restrict outR, int numSamples, float angle,
+                                     float increment, float leftGain, float rightGain, float shape) noexcept {
+            for (int i = 0; i < numSamples; i++) {
+                auto a = wrapAngle(angle + (float) i * increment);
+                auto wave = 2.0f * a * INV_TAU - 1.0f;
+                auto shaped = clamp(wave + withSignOf(shape, wave));
+                outL[i] += shaped * leftGain;
+                outR[i] += shaped * rightGain;
+            }
+            return wrapAngle(angle + (float) numSamples * increment);
+        }
+
+        forcedinline void svfLowpassStereo(float* __restrict left, float* __restrict right, int numSamples,
+                                           const float* __restrict g, float R2, float* state) noexcept {
+            float s1L = state[0], s2L = state[1], s1R = state[2], s2R = state[3];
+            for (int i = 0; i < numSamples; i++) {
+                auto gi = g[i];
+                auto h = 1.0f / (1.0f + R2 * gi + gi * gi);
+
+                auto hpL = h * (left[i] - s1L * (gi + R2) - s2L);
+                auto hpR = h * (right[i] - s1R * (gi + R2) - s2R);
+                auto bpL = hpL * gi + s1L;
+                auto bpR = hpR * gi + s1R;
+                s1L = hpL * gi + bpL;
+                s1R = hpR * gi + bpR;
+                auto lpL = bpL * gi + s2L;
+                auto lpR = bpR * gi + s2R;
+                s2L = bpL * gi + lpL;
+                s2R = bpR * gi + lpR;
+
+                left[i] = lpL;
+                right[i] = lpR;
+            }
+            state[0] = s1L; state[1] = s2L; state[2] = s1R; state[3] = s2R;
+        }
+
+        /** Same curve as the old per-sample shapeCompoundWave: clamping before the cubic gives exactly the +-4/3
+         *  plateaus it had outside [-1, 1] */
+        forcedinline void shapeAndMix(float* __restrict outL, float* __restrict outR, const float* __restrict inL,
+                                      const float* __restrict inR, const float* __restrict gain, int numSamples,
+                                      float dirt) noexcept {
+            constexpr float factor = 2.0f;
+            const float drive = 1.0f / factor + dirt * 10.0f;
+            for (int i = 0; i < numSamples; i++) {
+                auto l = clamp(inL[i] * drive);
+                auto r = clamp(inR[i] * drive);
+                outL[i] += factor * (l - l * l * l * (1.0f / 3.0f)) * gain[i];
+                outR[i] += factor * (r - r * r * r * (1.0f / 3.0f)) * gain[i];
+            }
+        }
+
+        forcedinline void delayFeedbackMix(float* out, float* __restrict feedback, const float* in,
+                                           const float* __restrict delayed, int numSamples, float wet,
+                                           float fb) noexcept {
+            for (int i = 0; i < numSamples; i++) {
+                auto x = in[i];
+                auto d = delayed[i];
+                feedback[i] = x + fb * d;
+                out[i] = x + wet * d;
+            }
+        }
+
+        /** +1 where line k is the first of its pair in each butterfly stage, -1 where it's the second */
+        constexpr float HADAMARD_SIGNS[3][FDN_LINES] = {
+            { 1, -1, 1, -1, 1, -1, 1, -1 },
+            { 1, 1, -1, -1, 1, 1, -1, -1 },
+            { 1, 1, 1, 1, -1, -1, -1, -1 },
+        };
+
+        forcedinline void fdnFeedback(float* __restrict lanes, int numSamples, const float* __restrict gains,
+                                      float damping, float* __restrict state) noexcept {
+            constexpr int N = FDN_LINES;
+            float s[N], g[N];
+            for (int k = 0; k < N; k++) {
+                s[k] = state[k];
+                // The Hadamard butterflies below grow by sqrt(2) each, fold the normalisation into the gains
+                g[k] = gains[k] / MathConstants<float>::sqrt2 / 2.0f;
+            }
+            for (int i = 0; i < numSamples; i++) {
+                auto* x = lanes + i * N;
+                float y[N];
+                for (int k = 0; k < N; k++) {
+                    s[k] = x[k] + damping * (s[k] - x[k]);
+                    y[k] = s[k] * g[k];
+                }
+                // Fast Walsh-Hadamard transform: each stage pairs line k with k ^ h, written as a shuffle plus a
+                // signed add so that there are no branches in the way of the vectoriser
+                for (int stage = 0; stage < 3; stage++) {
+                    auto h = 1 << stage;
+                    float t[N];
+                    for (int k = 0; k < N; k++) {
+                        t[k] = y[k ^ h] + HADAMARD_SIGNS[stage][k] * y[k];
+                    }
+                    copy(t, N, y);
+                }
+                copy(y, N, x);
+            }
+            copy(s, N, state);
+        }
+
+        forcedinline void phaserStereo(float* __restrict left, float* __restrict right, int numSamples,
+                                       const float* __restrict G, float dryGain, float wetGain,
+                                       float* __restrict state) noexcept {
+            static_assert(PHASER_STAGES == 6, "the stages are unrolled below");
+            float s[PHASER_STAGES][2];
+            copy(state, PHASER_STAGES * 2, &s[0][0]);
+            for (int i = 0; i < numSamples; i++) {
+                auto g = G[i];
+                float dry[2] = { left[i], right[i] };
+                float x[2] = { dry[0], dry[1] };
+                // Written out stage by stage so that the left/right pairs are straight-line code, which the compiler
+                // can pack into one register
+                auto allpass = [&](float* stageState) {
+                    for (int c = 0; c < 2; c++) {
+                        auto v = g * (x[c] - stageState[c]);
+                        auto lp = v + stageState[c];
+                        stageState[c] = lp + v;
+                        x[c] = 2.0f * lp - x[c];
+                    }
+                };
+                allpass(s[0]); allpass(s[1]); allpass(s[2]); allpass(s[3]); allpass(s[4]); allpass(s[5]);
+                left[i] = dryGain * dry[0] + wetGain * x[0];
+                right[i] = dryGain * dry[1] + wetGain * x[1];
+            }
+            copy(&s[0][0], PHASER_STAGES * 2, state);
+        }
+
+        forcedinline float gainAndPeak(float* __restrict left, float* __restrict right, int numSamples,
+                                       float gain) noexcept {
+            float peak = 0.0f;
+            for (int i = 0; i < numSamples; i++) {
+                auto l = left[i] * gain;
+                auto r = right[i] * gain;
+                left[i] = l;
+                right[i] = r;
+                peak = maximum(peak, maximum(magnitude(l), magnitude(r)));
+            }
+            return peak;
+        }
+    }
+
+    /** Stamps out one copy of every kernel compiled for a particular instruction set */
+    #define CRYPT_KERNEL_VARIANT(variantName, targetAttribute) \
+        namespace variantName { \
+            targetAttribute inline float unisonSaw(float* outL, float* outR, int numSamples, float angle, \
+                    float increment, float leftGain, float rightGain, float shape) noexcept { \
+                return detail::unisonSaw(outL, outR, numSamples, angle, increment, leftGain, rightGain, shape); \
+            } \
+            targetAttribute inline void svfLowpassStereo(float* left, float* right, int numSamples, const float* g, \
+                    float R2, float* state) noexcept { \
+                detail::svfLowpassStereo(left, right, numSamples, g, R2, state); \
+            } \
+            targetAttribute inline void shapeAndMix(float* outL, float* outR, const float* inL, const float* inR, \
+                    const float* gain, int numSamples, float dirt) noexcept { \
+                detail::shapeAndMix(outL, outR, inL, inR, gain, numSamples, dirt); \
+            } \
+            targetAttribute inline void delayFeedbackMix(float* out, float* feedback, const float* in, \
+                    const float* delayed, int numSamples, float wet, float fb) noexcept { \
+                detail::delayFeedbackMix(out, feedback, in, delayed, numSamples, wet, fb); \
+            } \
+            targetAttribute inline void fdnFeedback(float* lanes, int numSamples, const float* gains, float damping, \
+                    float* state) noexcept { \
+                detail::fdnFeedback(lanes, numSamples, gains, damping, state); \
+            } \
+            targetAttribute inline void phaserStereo(float* left, float* right, int numSamples, const float* G, \
+                    float dryGain, float wetGain, float* state) noexcept { \
+                detail::phaserStereo(left, right, numSamples, G, dryGain, wetGain, state); \
+            } \
+            targetAttribute inline float gainAndPeak(float* left, float* right, int numSamples, float gain) noexcept { \
+                return detail::gainAndPeak(left, right, numSamples, gain); \
+            } \
+            inline constexpr KernelSet kernels { &unisonSaw, &svfLowpassStereo, &shapeAndMix, &delayFeedbackMix, \
+                                                 &fdnFeedback, &phaserStereo, &gainAndPeak }; \
+        }
+
+    CRYPT_KERNEL_VARIANT(generic, )
+   #if CRYPT_KERNEL_MULTIVERSIONING
+    CRYPT_KERNEL_VARIANT(avx2, __attribute__((target("avx2,fma"))))
+    CRYPT_KERNEL_VARIANT(avx512, __attribute__((target("avx512f,avx512vl,avx2,fma"))))
+   #endif
+
+    #undef CRYPT_KERNEL_VARIANT
+
+   #if JUCE_GCC
+    #pragma GCC pop_options
+   #endif
+
+    inline String getIsaName(Isa isa) {
+        switch (isa) {
+            case Isa::avx512: return "avx512";
+            case Isa::avx2: return "avx2";
+            default: return "generic";
+        }
+    }
+
+    inline bool isSupported(Isa isa) {
+       #if CRYPT_KERNEL_MULTIVERSIONING
+        switch (isa) {
+            case Isa::avx512: return SystemStats::hasAVX512F() && SystemStats::hasAVX512VL() && SystemStats::hasFMA3();
+            case Isa::avx2: return SystemStats::hasAVX2() && SystemStats::hasFMA3();
+            default: return true;
+        }
+       #else
+        return isa == Isa::generic;
+       #endif
+    }
+
+    /** Best supported set at or below the one asked for */
+    inline Isa bestSupported(Isa wanted) {
+        for (auto isa: { Isa::avx512, Isa::avx2 }) {
+            if (isa <= wanted && isSupported(isa)) {
+                return isa;
+            }
+        }
+        return Isa::generic;
+    }
+
+    inline const KernelSet* kernelsFor(Isa isa) {
+       #if CRYPT_KERNEL_MULTIVERSIONING
+        switch (isa) {
+            case Isa::avx512: return &avx512::kernels;
+            case Isa::avx2: return &avx2::kernels;
+            default: break;
+        }
+       #endif
+        return &generic::kernels;
+    }
+
+    namespace detail {
+        inline Isa initialIsa() {
+            auto forced = SystemStats::getEnvironmentVariable("CRYPT_FORCE_ISA", {}).trim().toLowerCase();
+            for (auto isa: { Isa::generic, Isa::avx2, Isa::avx512 }) {
+                if (forced == getIsaName(isa)) {
+                    return bestSupported(isa);
+                }
+            }
+            return bestSupported(Isa::avx512);
+        }
+
+        inline std::atomic<Isa>& activeIsa() {
+            static std::atomic<Isa> isa { initialIsa() };
+            return isa;
+        }
+    }
+
+    inline Isa getActiveIsa() {
+        return detail::activeIsa().load(std::memory_order_relaxed);
+    }
+
+    /** Pin the kernels to a particular instruction set (or the best the CPU can do below it). Safe to call while
+     *  audio is running, blocks pick it up the next time they fetch their kernels */
+    inline void forceIsa(Isa isa) {
+        detail::activeIsa().store(bestSupported(isa), std::memory_order_relaxed);
+    }
+
+    /** Fetch once per block. The first call reads the environment, so make it from prepareToPlay */
+    inline const KernelSet& get() noexcept {
+        return *kernelsFor(getActiveIsa());
+    }
+}
@@ -0,0 +1,156 @@
+/*
+    Copyright 2025 David Whiting
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <JuceHeader.h>
+#include "DspKernels.hpp"
+
+/** A feedback delay network reverb: eight delay lines of mutually prime lengths, each damped and attenuated, then all
+ *  mixed back into each other through a Hadamard matrix. Every line gets a bit of every other line on every pass, so
+ *  the echo density builds up much faster than in a Freeverb, and with half the lines going to each side the tail is
+ *  properly wide.
+ *
+ *  The lines are kept as one sample of each line side by side, so the whole feedback path for a sample is a handful
+ *  of operations on a single SIMD register (see DspKernels::fdnFeedback). Reading and writing the lines is done a
+ *  chunk at a time as contiguous spans, which works because no chunk is longer than the shortest line.
+ */
+class FdnReverb {
+    private:
+    static constexpr int N = DspKernels::FDN_LINES;
+    static constexpr int CHUNK = 64;
+
+    /** Line lengths at 44.1kHz, from about 32ms to 66ms */
+    static constexpr int LINE_LENGTHS[N] = { 1433, 1601, 1867, 2053, 2251, 2399, 2617, 2897 };
+
+    /** One channel per line, all the same power of two length so they can share a write index and mask */
+    AudioBuffer<float> lines;
+    int lengths[N] = {};
+    int mask = 0;
+    int writeIndex = 0;
+
+    float gains[N] = {};
+    float dampingState[N] = {};
+    float damping = 0.0f;
+    float decaySeconds = 1.0f;
+    float wetLevel = 0.0f;
+    float dryLevel = 1.0f;
+    double sampleRate = 44100.0;
+
+    void updateGains() {
+        for (int k = 0; k < N; k++) {
+            // -60dB after decaySeconds, however many trips round this particular line that takes
+            gains[k] = std::pow(10.0f, -3.0f * (float) lengths[k] / (decaySeconds * (float) sampleRate));
+        }
+    }
+
+    void readLine(int line, int position, float* dest, int n) const {
+        auto start = position & mask;
+        auto first = jmin(n, mask + 1 - start);
+        auto* data = lines.getReadPointer(line);
+        std::copy(data + start, data + start + first, dest);
+        std::copy(data, data + (n - first), dest + first);
+    }
+
+    void writeLine(int line, const float* source, int n) {
+        auto first = jmin(n, mask + 1 - writeIndex);
+        auto* data = lines.getWritePointer(line);
+        std::copy(source, source + first, data + writeIndex);
+        std::copy(source + first, source + n, data);
+    }
+
+    public:
+    /** roomSize and damping go from 0 to 1 like in juce::Reverb; roomSize maps onto the decay time */
+    void setParameters(float roomSize, float newDamping, float wet, float dry) {
+        decaySeconds = 0.3f + 7.7f * roomSize * roomSize * roomSize;
+        damping = jlimit(0.0f, 0.95f, newDamping * 0.7f);
+        wetLevel = wet;
+        dryLevel = dry;
+        updateGains();
+    }
+
+    /** Time taken to decay to the silence threshold, plus the longest line for the last pass to come out */
+    double getTailLengthSeconds(float threshold) const {
+        auto thresholdDb = -20.0 * std::log10((double) threshold);
+        return decaySeconds * thresholdDb / 60.0 + LINE_LENGTHS[N - 1] / 44100.0;
+    }
+
+    void prepare(double newSampleRate) {
+        sampleRate = newSampleRate;
+        for (int k = 0; k < N; k++) {
+            lengths[k] = jmax(CHUNK, roundToInt(LINE_LENGTHS[k] * sampleRate / 44100.0));
+        }
+        lines.setSize(N, nextPowerOfTwo(lengths[N - 1] + 1));
+        mask = lines.getNumSamples() - 1;
+        updateGains();
+        reset();
+    }
+
+    void reset() {
+        lines.clear();
+        writeIndex = 0;
+        std::fill(std::begin(dampingState), std::end(dampingState), 0.0f);
+    }
+
+    void process(const dsp::ProcessContextReplacing<float>& context) {
+        auto block = context.getOutputBlock();
+        auto* left = block.getChannelPointer(0);
+        auto* right = block.getChannelPointer(block.getNumChannels() > 1 ? 1 : 0);
+        auto samples = (int) block.getNumSamples();
+
+        auto& kernels = DspKernels::get();
+        float span[CHUNK], inputL[CHUNK], inputR[CHUNK], lanes[CHUNK * N];
+
+        // Roughly matches the output level of juce::Reverb for the same wet setting
+        auto outputGain = wetLevel * 0.6f;
+
+        for (auto chunkStart = 0; chunkStart < samples; chunkStart += CHUNK) {
+            auto n = jmin(CHUNK, samples - chunkStart);
+            auto* l = left + chunkStart;
+            auto* r = right + chunkStart;
+
+            for (int k = 0; k < N; k++) {
+                readLine(k, writeIndex - lengths[k], span, n);
+                for (int i = 0; i < n; i++) {
+                    lanes[i * N + k] = span[i];
+                }
+            }
+
+            // Alternate signs in the output taps keep the two sides decorrelated
+            for (int i = 0; i < n; i++) {
+                auto* x = lanes + i * N;
+                auto wetL = x[0] - x[2] + x[4] - x[6];
+                auto wetR = x[1] - x[3] + x[5] - x[7];
+                inputL[i] = l[i];
+                inputR[i] = r[i];
+                l[i] = dryLevel * inputL[i] + outputGain * wetL;
+                r[i] = dryLevel * inputR[i] + outputGain * wetR;
+            }
+
+            kernels.fdnFeedback(lanes, n, gains, damping, dampingState);
+
+            // Left feeds the even lines and right the odd ones, the matrix spreads them out from there
+            for (int k = 0; k < N; k++) {
+                auto* input = (k & 1) ? inputR : inputL;
+                auto inputGain = (k & 2) ? -0.5f : 0.5f;
+                for (int i = 0; i < n; i++) {
+                    span[i] = lanes[i * N + k] + inputGain * input[i];
+                }
+                writeLine(k, span, n);
+            }
+            writeIndex = (writeIndex + n) & mask;
+        }
+    }
+};
@@ -0,0 +1,123 @@
+/*
+    Copyright 2025 David Whiting
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <JuceHeader.h>
+
+/** Drives all the redrawing in the editor, once per frame of the screen it's on.
+ *
+ *  Displays are Clients, which either mark themselves dirty when something they show has changed (from any thread),
+ *  or ask to be updated on every frame because they're showing live data. On each vblank the scheduler updates every
+ *  client that needs it, in one go. So however fast automation or audio data arrives, nothing is redrawn more than once
+ *  per frame, and the message thread's load follows the refresh rate of the screen.
+ *
+ *  While the host isn't the foreground application, frames are spaced out to BACKGROUND_FPS. While the editor isn't
+ *  showing at all (closed, minimised, or hidden by the host), nothing is updated, and clients are told so that they
+ *  can stop whatever is feeding them.
+ */
+class FrameScheduler: private ComponentListener {
+    public:
+    class Client {
+        public:
+        enum Mode { whenDirty, everyFrame };
+
+        /** Registers with the scheduler for as long as it exists. Dirty to begin with */
+        Client(FrameScheduler& scheduler, Mode mode): scheduler(scheduler), mode(mode) {
+            scheduler.clients.push_back(this);
+        }
+
+        virtual ~Client() {
+            auto& clients = scheduler.clients;
+            clients.erase(std::remove(clients.begin(), clients.end(), this), clients.end());
+        }
+
+        /** Safe from any thread. frameUpdate() will be called on the next frame */
+        void markDirty() {
+            dirty = true;
+        }
+
+        protected:
+        /** Message thread only, at most once per frame */
+        virtual void frameUpdate() = 0;
+
+        /** Message thread only. Called when the editor starts or stops showing; it starts off hidden */
+        virtual void frameVisibilityChanged(bool isVisible) {}
+
+        private:
+        friend class FrameScheduler;
+        FrameScheduler& scheduler;
+        const Mode mode;
+        std::atomic<bool> dirty { true };
+    };
+
+    private:
+    static constexpr double BACKGROUND_FPS = 10.0;
+
+    Component& editor;
+    std::vector<Client*> clients;
+    double lastFrame = 0.0;
+    bool visible = false;
+    VBlankAttachment vblank;
+
+    void updateVisibility() {
+        auto showing = editor.isShowing();
+        if (showing == visible) {
+            return;
+        }
+        visible = showing;
+        for (auto* client: clients) {
+            client->frameVisibilityChanged(visible);
+        }
+    }
+
+    void componentVisibilityChanged(Component&) override {
+        updateVisibility();
+    }
+
+    void componentParentHierarchyChanged(Component&) override {
+        updateVisibility();
+    }
+
+    void onVBlank() {
+        // isShowing() covers the window being minimised, which doesn't send any event of its own
+        updateVisibility();
+        if (! visible) {
+            return;
+        }
+
+        auto now = Time::getMillisecondCounterHiRes();
+        if (! Process::isForegroundProcess() && now - lastFrame < 1000.0 / BACKGROUND_FPS) {
+            return;
+        }
+        lastFrame = now;
+
+        for (auto* client: clients) {
+            if (client->dirty.exchange(false) || client->mode == Client::everyFrame) {
+                client->frameUpdate();
+            }
+        }
+    }
+
+    public:
+    /** Follows the vblank of whichever screen the component is on */
+    explicit FrameScheduler(Component& editor): editor(editor), vblank(&editor, [this] { onVBlank(); }) {
+        editor.addComponentListener(this);
+    }
+
+    ~FrameScheduler() override {
+        editor.removeComponentListener(this);
+    }
+};
@@ -19,15 +19,236 @@
 #include <JuceHeader.h>
 #include "CryptParameters.hpp"
 #include "CustomParameterModel.hpp"
+#include "DspKernels.hpp"
+#include "FdnReverb.hpp"
+#include "ConvolutionReverb.hpp"
+#include "MultiRate.hpp"
+#include "SineTable.hpp"
 
+/** Tracks how long an FX stage has been fed silence, so that it can stop processing once its own tail has decayed
+ *  and start again on the very next block that has anything in it */
+class SilenceDetector {
+    private:
+    int64 silentSamples = 0;
+    bool asleep = false;
+
+    public:
+    /** -80dB, comfortably below anything audible at the end of the chain */
+    static constexpr float THRESHOLD = 1.0e-4f;
+
+    enum class Activity { active, fallingAsleep, asleep };
+
+    static bool isSilent(const dsp::AudioBlock<const float>& block) {
+        for (size_t c = 0; c < block.getNumChannels(); c++) {
+            auto range = FloatVectorOperations::findMinAndMax(block.getChannelPointer(c), (int) block.getNumSamples());
+            if (range.getStart() < -THRESHOLD || range.getEnd() > THRESHOLD) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /** Call once per block with the stage's input. When this returns fallingAsleep the stage should flush whatever
+     *  residue is left in its state, so that it wakes up clean */
+    Activity update(const dsp::AudioBlock<const float>& input, double tailSeconds, double sampleRate) {
+        if (! isSilent(input)) {
+            silentSamples = 0;
+            asleep = false;
+            return Activity::active;
+        }
+        if (asleep) {
+            return Activity::asleep;
+        }
+        silentSamples += (int64) input.getNumSamples();
+        if ((double) silentSamples > tailSeconds * sampleRate) {
+            asleep = true;
+            return Activity::fallingAsleep;
+        }
+        return Activity::active;
+    }
+
+    /** Number of feedback passes before something decays below the threshold */
+    static double passesToSilence(float feedback) {
+        if (feedback <= 0.0f) {
+            return 0.0;
+        }
+        return std::ceil(std::log(THRESHOLD) / std::log(jmin(feedback, 0.999f)));
+    }
+};
+
+/** Explicit bypass switch for an FX stage, stored as a two-choice parameter so it shows up nicely in hosts */
+inline ParameterSpec bypassParameter(const String& id) {
+    return {.id = id, .name = "Bypass", .range = {0.0, 1.0, 1.0}, .def = 0.0f, .choices = {"Off", "On"}};
+}
+
+/** Takes an FX stage in and out of the chain. A stage that's bypassed, or whose mix makes it inaudible, isn't
+ *  processed at all; going in or out is a linear crossfade against the dry signal so there's no click. The stage's
+ *  output is mostly the dry signal plus a bit, so the two are correlated and the gains have to sum to one; an
+ *  equal-power fade would bump the level by 3dB halfway. A stage that comes back in is reset first, so it doesn't
+ *  replay whatever was left in it from before.
+ *
+ *  For a stage with latency, the dry signal is delayed to match all the time, including while the stage is skipped,
+ *  and a stage coming back in only starts fading up once its output has caught up. */
+class StageFader {
+    public:
+    enum class Action { skip, restart, process };
+
+    private:
+    static constexpr double FADE_SECONDS = 0.01;
+
+    /** 0 is fully out, 1 fully in */
+    float position = 1.0f;
+    float target = 1.0f;
+    float step = 0.01f;
+
+    /** Copy of the input while fading, or all the time for a stage with latency. Preallocated in prepare */
+    AudioBuffer<float> dry;
+    DelayCompensation alignment;
+    int maxLatency = 0;
+    int latency = 0;
+    /** Samples left before a restarted stage's output catches up and the fade can start */
+    int holdSamples = 0;
+
+    public:
+    /** maxStageLatency is the most the stage's latency can be set to later */
+    void prepare(const dsp::ProcessSpec& spec, int maxStageLatency = 0) {
+        step = (float) (1.0 / (FADE_SECONDS * spec.sampleRate));
+        dry.setSize((int) spec.numChannels, (int) spec.maximumBlockSize);
+        maxLatency = maxStageLatency;
+        alignment.prepare(maxLatency);
+        latency = -1;
+        setLatency(0);
+    }
+
+    /** For a stage whose latency changes along the way, eg. with eco mode. Audio thread only, before startBlock */
+    void setLatency(int stageLatency) {
+        stageLatency = jlimit(0, maxLatency, stageLatency);
+        if (stageLatency != latency) {
+            latency = stageLatency;
+            alignment.setDelay(latency);
+            alignment.reset();
+        }
+    }
+
+    /** Call before processing the stage with whether it should currently be heard */
+    Action startBlock(bool audible, dsp::AudioBlock<float>& block) {
+        auto wasOut = position <= 0.0f;
+        target = audible ? 1.0f : 0.0f;
+        auto settled = position == target;
+        if (settled && latency == 0) {
+            return audible ? Action::process : Action::skip;
+        }
+
+        auto channels = jmin((int) block.getNumChannels(), dry.getNumChannels());
+        auto samples = jmin((int) block.getNumSamples(), dry.getNumSamples());
+        for (int c = 0; c < channels; c++) {
+            FloatVectorOperations::copy(dry.getWritePointer(c), block.getChannelPointer((size_t) c), samples);
+        }
+        if (latency > 0) {
+            auto dryBlock = dsp::AudioBlock<float>(dry).getSubBlock(0, (size_t) samples);
+            alignment.process(dryBlock);
+        }
+
+        if (settled) {
+            // Skipping a stage with latency still has to delay the signal by as much as the stage would
+            if (! audible) {
+                for (int c = 0; c < channels; c++) {
+                    FloatVectorOperations::copy(block.getChannelPointer((size_t) c), dry.getReadPointer(c), samples);
+                }
+            }
+            return audible ? Action::process : Action::skip;
+        }
+        if (wasOut) {
+            holdSamples = latency;
+            return Action::restart;
+        }
+        return Action::process;
+    }
+
+    /** Call after processing the stage, to crossfade its output against the dry copy if it's on the way in or out */
+    void endBlock(dsp::AudioBlock<float>& block) {
+        if (position == target) {
+            return;
+        }
+
+        auto channels = jmin((int) block.getNumChannels(), dry.getNumChannels());
+        auto samples = jmin((int) block.getNumSamples(), dry.getNumSamples());
+        auto direction = target > position ? step : -step;
+        auto start = position;
+        auto hold = holdSamples;
+
+        for (int c = 0; c < channels; c++) {
+            auto* out = block.getChannelPointer((size_t) c);
+            auto* in = dry.getReadPointer(c);
+            auto p = start;
+            hold = holdSamples;
+            for (int i = 0; i < samples; i++) {
+                if (hold > 0) {
+                    hold--;
+                } else {
+                    p = jlimit(0.0f, 1.0f, p + direction);
+                }
+                out[i] = p * out[i] + (1.0f - p) * in[i];
+            }
+            position = p;
+        }
+        holdSamples = hold;
+    }
+};
+
+/** Feedback echo on both channels, with the right channel very slightly later than the left.
+ *
+ *  The delay line is a plain circular buffer per channel. While the delay time is settled, whole chunks are read out
+ *  of it as contiguous spans and interpolated, mixed and written back with vector operations. Only while the time is
+ *  gliding towards a new value does it fall back to an interpolated read per sample. */
 class StereoDelay: public dsp::ProcessorBase, public AudioProcessorValueTreeState::Listener {
     private:
-    dsp::DelayLine<float> delayLine;
+    /** Circular buffer per channel, a power of two long so that indices can be wrapped with a mask */
+    AudioBuffer<float> buffer;
+    int bufferMask = 0;
+    /** Where the next sample is written, the same for every channel */
+    int writeIndex = 0;
+
     float feedback = 0.5;
     float wet = 0.3;
     float delayTime = 375.0f;
     float smoothedDelayTime = 0.5f;
     double sampleRate = 44100.0;
+    SilenceDetector silence;
+    std::atomic<bool> bypassed { false };
+
+    static constexpr int CHUNK = 64;
+
+    /** Delay in samples for a time in ms; the right channel lags by an extra 1% of the time in samples */
+    float delayInSamples(float timeMs, int channel) const {
+        return (float) (sampleRate / 1000) * timeMs + timeMs * 0.01f * (float) channel;
+    }
+
+    /** Copy n samples starting at position (any integer, wrapped into the buffer) in at most two spans */
+    void readSpan(int channel, int position, float* dest, int n) const {
+        auto start = position & bufferMask;
+        auto first = jmin(n, bufferMask + 1 - start);
+        auto* data = buffer.getReadPointer(channel);
+        std::copy(data + start, data + start + first, dest);
+        std::copy(data, data + (n - first), dest + first);
+    }
+
+    void writeSpan(int channel, const float* source, int n) {
+        auto first = jmin(n, bufferMask + 1 - writeIndex);
+        auto* data = buffer.getWritePointer(channel);
+        std::copy(source, source + first, data + writeIndex);
+        std::copy(source + first, source + n, data);
+    }
+
+    /** Linear interpolation between the two samples either side of the delay, as seen from position now */
+    float readInterpolated(int channel, int now, float delay) const {
+        auto whole = (int) delay;
+        auto fraction = delay - (float) whole;
+        auto* data = buffer.getReadPointer(channel);
+        auto newer = data[(now - whole) & bufferMask];
+        auto older = data[(now - whole - 1) & bufferMask];
+        return newer + fraction * (older - newer);
+    }
 
     public:
 
@@ -35,14 +256,13 @@ class StereoDelay: public dsp::ProcessorBase, public AudioProcessorValueTreeStat
         return {
             {.id = CryptParameters::DelayTime, .name = "Time", .range = {2.0,2000.0,0.1,0.5}, .def = 375.0f},
             {.id = CryptParameters::DelayMix, .name = "Mix", .range = {0.0,1.0,0.01}, .def = 0.3f},
-            {.id = CryptParameters::DelayFeedback, .name = "Feedback", .range = {0.0,0.99,0.01}, .def = 0.5f}
+            {.id = CryptParameters::DelayFeedback, .name = "Feedback", .range = {0.0,0.99,0.01}, .def = 0.5f},
+            bypassParameter(CryptParameters::DelayBypass)
         };
     }
 
     void registerParams(AudioProcessorValueTreeState& state) {
-        for (auto p: params()) {
-            state.addParameterListener(p.id, this);
-        }
+        listenToParams(state, params(), this);
     }
 
     void unRegisterParams(AudioProcessorValueTreeState& state) {
@@ -58,61 +278,190 @@ class StereoDelay: public dsp::ProcessorBase, public AudioProcessorValueTreeStat
             wet = newValue;
         } else if (parameterID == CryptParameters::DelayFeedback) {
             feedback = newValue;
+        } else if (parameterID == CryptParameters::DelayBypass) {
+            bypassed = newValue >= 0.5f;
         }
     }
 
+    /** With no wet signal the echoes never make it to the output, whatever is still circulating in the line */
+    bool isAudible() const {
+        return ! bypassed && wet > 0.0f;
+    }
+
     void prepare (const dsp::ProcessSpec &spec) override {
-        delayLine.prepare(spec);
-        delayLine.setMaximumDelayInSamples(spec.sampleRate * 2.1);
         sampleRate = spec.sampleRate;
+        auto longest = (int) std::ceil(delayInSamples(2000.0f, (int) spec.numChannels)) + 2;
+        buffer.setSize((int) spec.numChannels, nextPowerOfTwo(longest));
+        bufferMask = buffer.getNumSamples() - 1;
+        reset();
     }
+    /** Each echo is another delay time later and quieter by the feedback amount */
+    double getTailLengthSeconds() const {
+        auto longestDelay = jmax(delayTime, smoothedDelayTime) * 1.01 / 1000.0;
+        return longestDelay * (1.0 + SilenceDetector::passesToSilence(feedback));
+    }
+
     void process (const dsp::ProcessContextReplacing< float > &context) override {
+        auto activity = silence.update(context.getInputBlock(), getTailLengthSeconds(), sampleRate);
+        if (activity != SilenceDetector::Activity::active) {
+            if (activity == SilenceDetector::Activity::fallingAsleep) {
+                reset();
+            }
+            return;
+        }
     
         auto input = context.getInputBlock();
         auto output = context.getOutputBlock();
-        auto channels = input.getNumChannels();
-        auto samples = input.getNumSamples();
-        if (abs(smoothedDelayTime - delayTime) < 0.1) {
-            smoothedDelayTime = delayTime;
-        }
-        
-        for (auto i = 0; i < samples; i++) {
-            smoothedDelayTime += (delayTime - smoothedDelayTime) * 0.0001;
+        auto channels = jmin((int) input.getNumChannels(), buffer.getNumChannels());
+        auto samples = (int) input.getNumSamples();
+
+        auto& kernels = DspKernels::get();
+        float times[CHUNK], span[CHUNK + 1], delayed[CHUNK], feedbackIn[CHUNK];
+
+        for (auto chunkStart = 0; chunkStart < samples;) {
+            if (abs(smoothedDelayTime - delayTime) < 0.1) {
+                smoothedDelayTime = delayTime;
+            }
+            auto gliding = smoothedDelayTime != delayTime;
+
+            // Everything read in a chunk has to have been written before it, so chunks can't be longer than the delay
+            auto shortestDelay = (int) delayInSamples(jmin(smoothedDelayTime, delayTime), 0);
+            auto n = jmin(CHUNK, samples - chunkStart, jmax(1, shortestDelay));
+
+            if (gliding) {
+                for (auto i = 0; i < n; i++) {
+                    smoothedDelayTime += (delayTime - smoothedDelayTime) * 0.0001;
+                    times[i] = smoothedDelayTime;
+                }
+            }
+
             for (auto c = 0; c < channels; c++) {
-                auto w = delayLine.popSample(c, (sampleRate / 1000) * smoothedDelayTime + smoothedDelayTime * (0.01) * c, true);
-                auto d = input.getSample(c, i);
-                float v = w * wet + d;
-                delayLine.pushSample(c, d + feedback * w);
-                output.setSample(c, i, v);
+                if (gliding) {
+                    for (auto i = 0; i < n; i++) {
+                        delayed[i] = readInterpolated(c, writeIndex + i, delayInSamples(times[i], c));
+                    }
+                } else {
+                    // One span covering both sides of every interpolated read, oldest sample first
+                    auto delay = delayInSamples(delayTime, c);
+                    auto whole = (int) delay;
+                    auto fraction = delay - (float) whole;
+                    readSpan(c, writeIndex - whole - 1, span, n + 1);
+                    FloatVectorOperations::copyWithMultiply(delayed, span, fraction, n);
+                    FloatVectorOperations::addWithMultiply(delayed, span + 1, 1.0f - fraction, n);
+                }
+                kernels.delayFeedbackMix(output.getChannelPointer((size_t) c) + chunkStart, feedbackIn,
+                                         input.getChannelPointer((size_t) c) + chunkStart, delayed, n, wet, feedback);
+                writeSpan(c, feedbackIn, n);
             }
+            writeIndex = (writeIndex + n) & bufferMask;
+            chunkStart += n;
         }
 
     }
     void reset () override {
-        delayLine.reset();
+        buffer.clear();
+        writeIndex = 0;
     }
 };
 
-class Phaser : public dsp::ProcessorWrapper<dsp::Phaser<float>>, public AudioProcessorValueTreeState::Listener {
-    public:
-    Phaser() {
-        processor.setCentreFrequency(1000.0f);
-        processor.setDepth(0.5f);
-        processor.setRate(0.2f);
-        processor.setMix(0.15f);
+/** Six-stage phaser swept by a sine LFO, the same design as juce::dsp::Phaser (which this used to wrap) without the
+ *  feedback, which Crypt never used. Both channels share the LFO and so the filter coefficients, so they run as two
+ *  lanes of the same allpass chain in one pass, and the dry/wet mix happens in that pass too. */
+class Phaser : public dsp::ProcessorBase, public AudioProcessorValueTreeState::Listener {
+    private:
+    static constexpr int CHUNK = 64;
+    /** Samples between LFO updates */
+    static constexpr int CONTROL_INTERVAL = 4;
+    static constexpr float CENTRE_FREQUENCY = 1000.0f;
+    static constexpr float MIN_FREQUENCY = 20.0f;
+
+    double sampleRate = 44100.0;
+    SilenceDetector silence;
+    std::atomic<bool> bypassed { false };
+
+    float depth = 0.5f;
+    float rate = 0.2f;
+    float mix = 0.3f;
+
+    SharedResourcePointer<SineTable> sine;
+
+    // Audio thread only
+    float lfoPhase = 0.0f;
+    float smoothedDepth = 0.5f;
+    float smoothedMix = 0.3f;
+    /** Per-chunk smoothing coefficient at each rate (full, half and quarter), about 50ms like the juce::Phaser ramps */
+    std::array<float, 3> smoothing { 0.1f, 0.1f, 0.1f };
+    float maxFrequency = 20000.0f;
+    float normalisedCentre = 0.5f;
+    float allpassState[DspKernels::PHASER_STAGES * 2] = {};
+
+    /** Eco mode: half and quarter rate versions of the signal path, plus what's needed to mix them back in. At either
+     *  reduced rate the output lags by the latency of the quarter rate path, so nothing shifts between the two; at the
+     *  full rate there's no latency at all, so that nobody pays for eco mode who isn't using it */
+    std::array<ReducedRateProcessor, 2> ecoPaths;
+    DelayCompensation dryAlignment;
+    DelayCompensation wetAlignment;
+    AudioBuffer<float> wetBuffer;
+    int activeEcoStages = 0;
+
+    /** Runs the allpass chain over a block at the given rate. With wetOnly it leaves out the dry signal, for when
+     *  that gets mixed back in at a different rate */
+    void render(float* left, float* right, int samples, double processingRate, bool wetOnly) {
+        auto& kernels = DspKernels::get();
+        float G[CHUNK];
+
+        // The sweep covers the same range at any rate, as far as the rate allows
+        auto highestFrequency = 0.49f * (float) processingRate;
+
+        auto coefficient = smoothing[(size_t) activeEcoStages];
+
+        for (auto chunkStart = 0; chunkStart < samples; chunkStart += CHUNK) {
+            auto n = jmin(CHUNK, samples - chunkStart);
+            smoothedDepth += (depth - smoothedDepth) * coefficient;
+            smoothedMix += (mix - smoothedMix) * coefficient;
+
+            for (int i = 0; i < n; i += CONTROL_INTERVAL) {
+                auto lfo = sine->lookup(lfoPhase) * smoothedDepth * 0.5f;
+                lfoPhase += (float) (rate * CONTROL_INTERVAL / processingRate);
+                lfoPhase -= std::floor(lfoPhase);
+
+                auto frequency = mapToLog10(jlimit(0.0f, 1.0f, normalisedCentre + lfo), MIN_FREQUENCY, maxFrequency);
+                auto g = std::tan(MathConstants<float>::pi * jmin(frequency, highestFrequency) / (float) processingRate);
+                std::fill(G + i, G + jmin(n, i + CONTROL_INTERVAL), g / (1.0f + g));
+            }
+
+            // 0.5 is actually full "mix" because it's half phased and half normal signal
+            auto wet = wetOnly ? 1.0f : smoothedMix * 0.5f;
+            kernels.phaserStereo(left + chunkStart, right + chunkStart, n, G, 1.0f - wet, wet, allpassState);
+        }
+    }
+
+    /** Everything but the dry alignment, which carries on through a change between the reduced rates */
+    void resetSignalPath() {
+        std::fill(std::begin(allpassState), std::end(allpassState), 0.0f);
+        smoothedDepth = depth;
+        smoothedMix = mix;
+        for (auto& path: ecoPaths) {
+            path.reset();
+        }
+        wetAlignment.reset();
     }
+
+    public:
+    /** The latency of the quarter rate path, in samples at the full rate, and so of the phaser in eco mode */
+    static constexpr int ECO_LATENCY = HalfBand::ROUND_TRIP_LATENCY * 3;
+
     static std::vector<ParameterSpec> params() {
         return {
             {.id = CryptParameters::PhaserDepth, .name = "Depth", .range = {0.0,1.0,0.01}, .def = 0.5f},
             {.id = CryptParameters::PhaserRate, .name = "Rate", .range = {0.02,1.0,0.01,0.5}, .def = 0.2f},
-            {.id = CryptParameters::PhaserMix, .name = "Mix", .range = {0.0,1.0,0.01}, .def = 0.3f}
+            {.id = CryptParameters::PhaserMix, .name = "Mix", .range = {0.0,1.0,0.01}, .def = 0.3f},
+            bypassParameter(CryptParameters::PhaserBypass)
         };
     }
 
     void registerParams(AudioProcessorValueTreeState& state) {
-        for (auto p: params()) {
-            state.addParameterListener(p.id, this);
-        }
+        listenToParams(state, params(), this);
     }
 
     void unRegisterParams(AudioProcessorValueTreeState& state) {
@@ -123,19 +472,148 @@ class Phaser : public dsp::ProcessorWrapper<dsp::Phaser<float>>, public AudioPro
 
     void parameterChanged (const String& parameterID, float newValue) override {
         if (parameterID == CryptParameters::PhaserDepth) {
-            processor.setDepth(newValue);
+            depth = newValue;
         } else if (parameterID == CryptParameters::PhaserRate) {
-            processor.setRate(newValue);
+            rate = newValue;
         } else if (parameterID == CryptParameters::PhaserMix) {
-            processor.setMix(newValue * 0.5f); // 0.5 is actually full "mix" because it's half phased and half normal signal
+            mix = newValue;
+        } else if (parameterID == CryptParameters::PhaserBypass) {
+            bypassed = newValue >= 0.5f;
         }
     }
-    
+
+    bool isAudible() const {
+        return ! bypassed && mix > 0.0f;
+    }
+
+    /** There's no feedback in the phaser, so the only tail is the allpass stages and the parameter smoothing */
+    double getTailLengthSeconds() const {
+        return 0.05;
+    }
+
+    /** None at the full rate, and ECO_LATENCY at either reduced rate. It stays the same while the stage is bypassed as
+     *  long as the StageFader is told. Audio thread only, changes with setEcoStages */
+    int getLatencySamples() const {
+        return activeEcoStages > 0 ? ECO_LATENCY : 0;
+    }
+
+    void prepare(const dsp::ProcessSpec& spec) override {
+        sampleRate = spec.sampleRate;
+        maxFrequency = jmin(20000.0f, 0.49f * (float) sampleRate);
+        normalisedCentre = mapFromLog10(CENTRE_FREQUENCY, MIN_FREQUENCY, maxFrequency);
+        // A chunk at a reduced rate covers more time
+        for (size_t stages = 0; stages < smoothing.size(); stages++) {
+            auto chunkRate = (float) sampleRate / (float) (1 << stages);
+            smoothing[stages] = 1.0f - std::exp(-(float) CHUNK / (0.05f * chunkRate));
+        }
+
+        for (int i = 0; i < (int) ecoPaths.size(); i++) {
+            ecoPaths[(size_t) i].prepare(i + 1, (int) spec.maximumBlockSize);
+        }
+        jassert(ecoPaths.back().getLatency() == ECO_LATENCY);
+        dryAlignment.prepare(ECO_LATENCY);
+        dryAlignment.setDelay(ECO_LATENCY);
+        wetAlignment.prepare(ECO_LATENCY);
+        wetBuffer.setSize(2, (int) spec.maximumBlockSize);
+        reset();
+    }
+
+    void reset() override {
+        resetSignalPath();
+        dryAlignment.reset();
+    }
+
+    /** 0 for full rate, 1 for half, 2 for quarter. Audio thread only, takes effect straight away, including on the
+     *  latency. Going in or out of eco mode starts the delayed dry signal afresh */
+    void setEcoStages(int stages) {
+        if (stages == activeEcoStages) {
+            return;
+        }
+        if ((stages > 0) != (activeEcoStages > 0)) {
+            dryAlignment.reset();
+        }
+        activeEcoStages = stages;
+        resetSignalPath();
+    }
+
+    void process(const dsp::ProcessContextReplacing<float>& context) override {
+        auto activity = silence.update(context.getInputBlock(), getTailLengthSeconds(), sampleRate);
+        if (activity != SilenceDetector::Activity::active) {
+            if (activity == SilenceDetector::Activity::fallingAsleep) {
+                reset();
+            }
+            return;
+        }
+
+        auto block = context.getOutputBlock();
+        // The plugin only supports stereo, and the kernel needs two distinct channels
+        jassert(block.getNumChannels() == 2);
+        auto samples = (int) block.getNumSamples();
+
+        if (activeEcoStages == 0) {
+            render(block.getChannelPointer(0), block.getChannelPointer(1), samples, sampleRate, false);
+            return;
+        }
+
+        // Only the phased signal goes through at the lower rate. It has to be mixed back with the dry signal
+        // sample-accurately (the notches come from the two cancelling), so both are brought to the same latency
+        auto& path = ecoPaths[(size_t) activeEcoStages - 1];
+        path.process(block, wetBuffer, [this, &path] (dsp::AudioBlock<float> low) {
+            render(low.getChannelPointer(0), low.getChannelPointer(1), (int) low.getNumSamples(),
+                   sampleRate / path.getFactor(), true);
+        });
+        auto wetBlock = dsp::AudioBlock<float>(wetBuffer).getSubBlock(0, (size_t) samples);
+        wetAlignment.setDelay(ECO_LATENCY - path.getLatency());
+        wetAlignment.process(wetBlock);
+        dryAlignment.process(block);
+
+        auto wet = smoothedMix * 0.5f;
+        for (int c = 0; c < 2; c++) {
+            auto* out = block.getChannelPointer((size_t) c);
+            FloatVectorOperations::multiply(out, 1.0f - wet, samples);
+            FloatVectorOperations::addWithMultiply(out, wetBuffer.getReadPointer(c), wet, samples);
+        }
+    }
+
 };
 
-class CryptReverb : public dsp::ProcessorWrapper<dsp::Reverb>, public AudioProcessorValueTreeState::Listener {
+/** The Void. Space drives either the original juce::Reverb (Classic), the denser and cheaper FdnReverb, or a
+ *  convolution with an impulse response loaded from disk. The IR's path is kept as a property of the plugin state so
+ *  it's saved and restored along with everything else */
+class CryptReverb : public dsp::ProcessorWrapper<dsp::Reverb>, public AudioProcessorValueTreeState::Listener,
+                    public ValueTree::Listener {
     private:
+    enum Mode { classic = 0, fdn = 1, convolution = 2 };
+
+    double sampleRate = 44100.0;
+    float space = 0.2f;
+    SilenceDetector silence;
+    FdnReverb fdnReverb;
+
+    /** Costs nothing until an impulse response is loaded, and hands its engines to the audio thread itself */
+    ConvolutionReverb convolutionReverb;
+
+    /** Message thread only */
+    String impulseResponsePath;
+
+    /** Eco mode: half and quarter rate instances of the algorithmic reverbs, producing only the wet signal. The dry
+     *  signal stays at the full rate, and the small delay on the wet from the resampling just adds to the pre-delay.
+     *  Convolution always runs at the full rate */
+    std::array<dsp::Reverb, 2> ecoClassicReverbs;
+    std::array<FdnReverb, 2> ecoFdnReverbs;
+    std::array<ReducedRateProcessor, 2> ecoPaths;
+    AudioBuffer<float> wetBuffer;
+    std::atomic<float> dryLevel { 1.0f };
+
+    std::atomic<int> mode { classic };
+    std::atomic<bool> bypassed { false };
+    // Audio thread only
+    int activeMode = classic;
+    int ecoStages = 0;
+    int activeEcoStages = 0;
+
     void setSpace(float space) {
+        this->space = space;
         Reverb::Parameters params {
                 .roomSize = 0.2f + 0.8f * space,
                 .damping = 0.8f - 0.7f * space,
@@ -145,33 +623,180 @@ class CryptReverb : public dsp::ProcessorWrapper<dsp::Reverb>, public AudioProce
                 .freezeMode = 0.0f};
 
         processor.setParameters(params);
+        fdnReverb.setParameters(params.roomSize, params.damping, params.wetLevel, params.dryLevel);
+        convolutionReverb.setParameters(params.wetLevel, params.dryLevel);
+
+        dryLevel = params.dryLevel;
+        auto wetOnly = params;
+        wetOnly.dryLevel = 0.0f;
+        for (auto& reverb: ecoClassicReverbs) {
+            reverb.setParameters(wetOnly);
+        }
+        for (auto& reverb: ecoFdnReverbs) {
+            reverb.setParameters(wetOnly.roomSize, wetOnly.damping, wetOnly.wetLevel, 0.0f);
+        }
+    }
+
+    void processReducedRate(dsp::AudioBlock<float>& block) {
+        auto index = (size_t) activeEcoStages - 1;
+        auto& path = ecoPaths[index];
+        path.process(block, wetBuffer, [this, index] (dsp::AudioBlock<float> low) {
+            dsp::ProcessContextReplacing<float> lowContext(low);
+            if (activeMode == fdn) {
+                ecoFdnReverbs[index].process(lowContext);
+            } else {
+                ecoClassicReverbs[index].process(lowContext);
+            }
+        });
+
+        auto samples = (int) block.getNumSamples();
+        auto dry = dryLevel.load();
+        for (int c = 0; c < 2; c++) {
+            auto* out = block.getChannelPointer((size_t) c);
+            FloatVectorOperations::multiply(out, dry, samples);
+            FloatVectorOperations::add(out, wetBuffer.getReadPointer(c), samples);
+        }
+    }
+
+    void updateImpulseResponse(const ValueTree& tree) {
+        auto path = tree.getProperty(Identifier(CryptParameters::ImpulseResponsePath)).toString();
+        if (path == impulseResponsePath) {
+            return;
+        }
+        impulseResponsePath = path;
+        if (path.isNotEmpty()) {
+            convolutionReverb.load(File(path));
+        } else {
+            convolutionReverb.unload();
+        }
+    }
+
+    void valueTreePropertyChanged(ValueTree& tree, const Identifier& property) override {
+        // Parameter changes in the child trees come through here too
+        if (property == Identifier(CryptParameters::ImpulseResponsePath)) {
+            updateImpulseResponse(tree);
+        }
+    }
+
+    /** The whole state tree gets swapped out when a preset or a saved session is loaded */
+    void valueTreeRedirected(ValueTree& tree) override {
+        updateImpulseResponse(tree);
     }
     void parameterChanged (const String& parameterID, float newValue) override {
         if (parameterID == CryptParameters::Space) {
             setSpace(newValue);
-        } 
+        } else if (parameterID == CryptParameters::ReverbMode) {
+            mode = roundToInt(newValue);
+        } else if (parameterID == CryptParameters::ReverbBypass) {
+            bypassed = newValue >= 0.5f;
+        }
     }
 
     public:
     static std::vector<ParameterSpec> params() {
         return {
             {.id = CryptParameters::Space, .name = "Space", .range = {0.0,1.0,0.01}, .def = 0.2f},
+            {.id = CryptParameters::ReverbMode, .name = "Reverb Mode", .range = {0.0, 2.0, 1.0}, .def = 0.0f,
+                .choices = {"Classic", "FDN", "Convolution"}},
+            bypassParameter(CryptParameters::ReverbBypass)
         };
     }
 
+    /** All the modes are fully dry with no Space */
+    bool isAudible() const {
+        return ! bypassed && space > 0.0f;
+    }
+
     void registerParams(AudioProcessorValueTreeState& state) {
-        for (auto p: params()) {
-            state.addParameterListener(p.id, this);
-        }
+        listenToParams(state, params(), this);
+        state.state.addListener(this);
+        updateImpulseResponse(state.state);
     }
 
     void unRegisterParams(AudioProcessorValueTreeState& state) {
         for (auto p: params()) {
             state.removeParameterListener(p.id, this);
         }
+        state.state.removeListener(this);
     }
 
     CryptReverb() {
         setSpace(0.2f);
     }
+
+    /** In Classic mode juce::Reverb is a Freeverb, so the tail is set by how many trips round its longest comb filter
+     *  (1617 samples plus stereo spread at 44.1kHz, scaled with the sample rate) it takes to get down to silence. The
+     *  comb feedback is roomSize * 0.28 + 0.7; damping only makes it shorter so this errs on the long side */
+    double getTailLengthSeconds() const {
+        if (mode == fdn) {
+            return fdnReverb.getTailLengthSeconds(SilenceDetector::THRESHOLD);
+        } else if (mode == convolution) {
+            return 0.05 + convolutionReverb.getTailLengthSeconds();
+        }
+        constexpr double longestCombSeconds = (1617.0 + 23.0) / 44100.0;
+        auto roomSize = 0.2f + 0.8f * space;
+        return 0.05 + longestCombSeconds * SilenceDetector::passesToSilence(roomSize * 0.28f + 0.7f);
+    }
+
+    void prepare(const dsp::ProcessSpec& spec) override {
+        sampleRate = spec.sampleRate;
+        ProcessorWrapper::prepare(spec);
+        fdnReverb.prepare(spec.sampleRate);
+        convolutionReverb.prepare(spec);
+
+        for (int i = 0; i < (int) ecoPaths.size(); i++) {
+            auto& path = ecoPaths[(size_t) i];
+            path.prepare(i + 1, (int) spec.maximumBlockSize);
+            auto lowRate = spec.sampleRate / path.getFactor();
+            ecoClassicReverbs[(size_t) i].prepare({lowRate, spec.maximumBlockSize / (uint32) path.getFactor() + 1, 2});
+            ecoFdnReverbs[(size_t) i].prepare(lowRate);
+        }
+        wetBuffer.setSize(2, (int) spec.maximumBlockSize);
+    }
+
+    void reset() override {
+        ProcessorWrapper::reset();
+        fdnReverb.reset();
+        convolutionReverb.reset();
+        for (int i = 0; i < (int) ecoPaths.size(); i++) {
+            ecoPaths[(size_t) i].reset();
+            ecoClassicReverbs[(size_t) i].reset();
+            ecoFdnReverbs[(size_t) i].reset();
+        }
+    }
+
+    /** 0 for full rate, 1 for half, 2 for quarter. Audio thread only, takes effect from the next block */
+    void setEcoStages(int stages) {
+        ecoStages = stages;
+    }
+
+    void setNonRealtime(bool isNonRealtime) {
+        convolutionReverb.setNonRealtime(isNonRealtime);
+    }
+
+    void process(const dsp::ProcessContextReplacing<float>& context) override {
+        // Whichever engine takes over starts from silence rather than whatever it had left over from last time
+        if (mode != activeMode || ecoStages != activeEcoStages) {
+            activeMode = mode;
+            activeEcoStages = ecoStages;
+            reset();
+        }
+
+        auto activity = silence.update(context.getInputBlock(), getTailLengthSeconds(), sampleRate);
+        if (activity == SilenceDetector::Activity::active) {
+            if (activeMode == convolution) {
+                // Passes straight through until an impulse response has been chosen
+                convolutionReverb.process(context);
+            } else if (activeEcoStages > 0) {
+                auto block = context.getOutputBlock();
+                processReducedRate(block);
+            } else if (activeMode == fdn) {
+                fdnReverb.process(context);
+            } else {
+                ProcessorWrapper::process(context);
+            }
+        } else if (activity == SilenceDetector::Activity::fallingAsleep) {
+            reset();
+        }
+    }
 };
@@ -0,0 +1,198 @@
+/*
+    Copyright 2025 David Whiting
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <JuceHeader.h>
+
+/** Gets MIDI from the message thread to the audio thread without either of them ever waiting on the other.
+ *
+ *  MidiKeyboardState::processNextMidiBuffer takes a lock that the on-screen keyboard also takes, so clicking a key
+ *  could hold up the audio thread. Instead the keyboard state now only lives on the message thread, and this listens
+ *  to it and pushes the notes into a single-producer/single-consumer FIFO which the audio thread drains. Anything
+ *  else that wants to play the synth directly (eg. a test harness) can push into the same queue.
+ *
+ *  The host's notes go the other way through a second FIFO, so that the keyboard still lights up when something else
+ *  is playing the synth. Those notes are put on the keyboard without being sent back to the synth, and only ever
+ *  released by the host, so they can't get tangled up with keys held down with the mouse.
+ */
+class MidiInjectionQueue : public MidiKeyboardState::Listener {
+    private:
+    struct Event {
+        uint8 data[3];
+        int numBytes;
+        int samplePosition;
+    };
+
+    /** One producer thread and one consumer thread, neither of which ever waits or allocates */
+    class Fifo {
+        private:
+        static constexpr int CAPACITY = 1024;
+
+        AbstractFifo fifo { CAPACITY };
+        std::array<Event, CAPACITY> events;
+
+        public:
+        /** Only short messages (notes, controllers, pitch bend...) fit; returns false if the message was too long or
+         *  the queue is full */
+        bool push(const uint8* data, int numBytes, int samplePosition) {
+            if (numBytes <= 0 || numBytes > 3) {
+                return false;
+            }
+
+            int start1, size1, start2, size2;
+            fifo.prepareToWrite(1, start1, size1, start2, size2);
+            if (size1 + size2 == 0) {
+                return false;
+            }
+
+            auto& event = events[(size_t) (size1 > 0 ? start1 : start2)];
+            std::copy(data, data + numBytes, event.data);
+            event.numBytes = numBytes;
+            event.samplePosition = samplePosition;
+
+            fifo.finishedWrite(1);
+            return true;
+        }
+
+        /** Hands everything pending to callback, oldest first */
+        template <typename Callback>
+        void popEach(Callback&& callback) {
+            int start1, size1, start2, size2;
+            fifo.prepareToRead(fifo.getNumReady(), start1, size1, start2, size2);
+
+            for (int i = start1; i < start1 + size1; i++) {
+                callback(events[(size_t) i]);
+            }
+            for (int i = start2; i < start2 + size2; i++) {
+                callback(events[(size_t) i]);
+            }
+
+            fifo.finishedRead(size1 + size2);
+        }
+    };
+
+    Fifo toAudio;
+    Fifo fromHost;
+
+    /** Whether the audio thread should bother passing the host's notes on */
+    std::atomic<bool> mirroring { false };
+
+    // Message thread only
+    /** Set while host notes are being put on the keyboard, so that they aren't sent back to the synth */
+    bool applyingHostNotes = false;
+    /** Channels (one bit each) on which the host is holding down each key of the keyboard */
+    std::array<uint16, 128> hostNotes {};
+
+    void releaseHostNote(MidiKeyboardState& keyboard, int channel, int note) {
+        auto bit = (uint16) (1 << (channel - 1));
+        if ((hostNotes[(size_t) note] & bit) != 0) {
+            hostNotes[(size_t) note] &= (uint16) ~bit;
+            keyboard.noteOff(channel, note, 0.0f);
+        }
+    }
+
+    void applyHostNote(MidiKeyboardState& keyboard, const MidiMessage& message) {
+        auto channel = message.getChannel();
+        if (channel < 1 || channel > 16) {
+            return;
+        }
+        if (message.isNoteOn()) {
+            auto note = message.getNoteNumber();
+            // A key held down with the mouse stays the mouse's
+            if (! keyboard.isNoteOn(channel, note)) {
+                hostNotes[(size_t) note] |= (uint16) (1 << (channel - 1));
+                keyboard.noteOn(channel, note, message.getFloatVelocity());
+            }
+        } else if (message.isNoteOff()) {
+            releaseHostNote(keyboard, channel, message.getNoteNumber());
+        } else if (message.isAllNotesOff() || message.isAllSoundOff()) {
+            for (int note = 0; note < 128; note++) {
+                releaseHostNote(keyboard, channel, note);
+            }
+        }
+    }
+
+    void addToBuffer(MidiBuffer& midi, const Event& event, int numSamples) const {
+        midi.addEvent(event.data, event.numBytes, jlimit(0, jmax(0, numSamples - 1), event.samplePosition));
+    }
+
+    public:
+    /** Producer side - only ever call this from one thread (normally the message thread). The sample position is
+     *  relative to the start of the next block the audio thread processes. Only short messages (notes, controllers,
+     *  pitch bend...) fit; returns false if the message was too long or the queue is full. */
+    bool push(const MidiMessage& message, int samplePosition = 0) {
+        return toAudio.push(message.getRawData(), message.getRawDataSize(), samplePosition);
+    }
+
+    /** Consumer side - call from the audio thread only. Adds everything pending into midi, which should have room
+     *  reserved already so that this doesn't allocate */
+    void popInto(MidiBuffer& midi, int numSamples) {
+        toAudio.popEach([&](const Event& event) { addToBuffer(midi, event, numSamples); });
+    }
+
+    /** Audio thread only. Passes the notes in the host's MIDI on to the keyboard, while anything is mirroring them */
+    void mirrorHostNotes(const MidiBuffer& midi) {
+        if (! mirroring.load(std::memory_order_relaxed)) {
+            return;
+        }
+        for (const auto metadata: midi) {
+            auto message = metadata.getMessage();
+            if (message.isNoteOnOrOff() || message.isAllNotesOff() || message.isAllSoundOff()) {
+                fromHost.push(metadata.data, metadata.numBytes, 0);
+            }
+        }
+    }
+
+    /** Message thread only. Starts or stops showing the host's notes on the keyboard, eg. while the editor is open.
+     *  Stopping lets go of every key the host was holding down on it */
+    void setMirroring(MidiKeyboardState& keyboard, bool shouldMirror) {
+        if (shouldMirror) {
+            // Whatever's left over from the last time may have lost its note offs, so start afresh
+            fromHost.popEach([](const Event&) {});
+            mirroring = true;
+            return;
+        }
+
+        mirroring = false;
+        updateKeyboard(keyboard);
+        const ScopedValueSetter<bool> applying(applyingHostNotes, true);
+        for (int note = 0; note < 128; note++) {
+            for (int channel = 1; channel <= 16; channel++) {
+                releaseHostNote(keyboard, channel, note);
+            }
+        }
+    }
+
+    /** Message thread only. Puts whatever the host has played since the last call on the keyboard */
+    void updateKeyboard(MidiKeyboardState& keyboard) {
+        const ScopedValueSetter<bool> applying(applyingHostNotes, true);
+        fromHost.popEach([&](const Event& event) {
+            applyHostNote(keyboard, MidiMessage(event.data, event.numBytes, 0.0));
+        });
+    }
+
+    void handleNoteOn(MidiKeyboardState*, int midiChannel, int midiNoteNumber, float velocity) override {
+        if (! applyingHostNotes) {
+            push(MidiMessage::noteOn(midiChannel, midiNoteNumber, velocity));
+        }
+    }
+
+    void handleNoteOff(MidiKeyboardState*, int midiChannel, int midiNoteNumber, float velocity) override {
+        if (! applyingHostNotes) {
+            push(MidiMessage::noteOff(midiChannel, midiNoteNumber, velocity));
+        }
+    }
+};
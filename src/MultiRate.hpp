@@ -0,0 +1,323 @@
+/*
+    Copyright 2025 David Whiting
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <JuceHeader.h>
+#include "CryptParameters.hpp"
+#include "CustomParameterModel.hpp"
+
+/** Windowed-sinc half-band lowpass used for going down and up by a factor of two. In a half-band filter every other
+ *  tap is zero apart from the centre one, so each output only costs half the taps */
+namespace HalfBand {
+    constexpr int TAPS = 23;
+    /** Odd, so the non-zero taps either side of it are the even-indexed ones */
+    constexpr int CENTRE = (TAPS - 1) / 2;
+
+    inline const std::array<float, TAPS>& coefficients() {
+        static const auto taps = [] {
+            std::array<float, TAPS> h {};
+            double sideSum = 0.0;
+            for (int k = 0; k < TAPS; k += 2) {
+                auto n = k - CENTRE;
+                auto x = MathConstants<double>::twoPi * k / (TAPS - 1);
+                auto blackman = 0.42 - 0.5 * std::cos(x) + 0.08 * std::cos(2.0 * x);
+                auto sinc = std::sin(MathConstants<double>::halfPi * n) / (MathConstants<double>::pi * n);
+                h[(size_t) k] = (float) (sinc * blackman);
+                sideSum += sinc * blackman;
+            }
+            // Both polyphase branches should have exactly unity gain at DC
+            for (int k = 0; k < TAPS; k += 2) {
+                h[(size_t) k] *= (float) (0.5 / sideSum);
+            }
+            h[CENTRE] = 0.5f;
+            return h;
+        }();
+        return taps;
+    }
+
+    /** Delay through a decimator and interpolator pair, in samples at the higher rate */
+    constexpr int ROUND_TRIP_LATENCY = 2 * CENTRE;
+}
+
+class HalfBandDecimator {
+    private:
+    /** The last TAPS - 1 inputs, followed by the current block */
+    std::vector<float> work;
+
+    public:
+    void prepare(int maxInput) {
+        work.assign((size_t) (HalfBand::TAPS - 1 + maxInput), 0.0f);
+    }
+
+    void reset() {
+        std::fill(work.begin(), work.end(), 0.0f);
+    }
+
+    /** numInput must be even, writes numInput / 2 samples */
+    void process(const float* input, int numInput, float* output) {
+        auto& h = HalfBand::coefficients();
+        auto* x = work.data() + HalfBand::TAPS - 1;
+        std::copy(input, input + numInput, x);
+
+        for (int m = 0; m < numInput / 2; m++) {
+            auto* newest = x + 2 * m + 1;
+            auto sum = h[HalfBand::CENTRE] * newest[-HalfBand::CENTRE];
+            for (int k = 0; k < HalfBand::TAPS; k += 2) {
+                sum += h[(size_t) k] * newest[-k];
+            }
+            output[m] = sum;
+        }
+
+        std::copy(x + numInput - (HalfBand::TAPS - 1), x + numInput, work.data());
+    }
+};
+
+class HalfBandInterpolator {
+    private:
+    static constexpr int HISTORY = HalfBand::TAPS / 2;
+
+    /** The last HISTORY inputs, followed by the current block */
+    std::vector<float> work;
+
+    public:
+    void prepare(int maxInput) {
+        work.assign((size_t) (HISTORY + maxInput), 0.0f);
+    }
+
+    void reset() {
+        std::fill(work.begin(), work.end(), 0.0f);
+    }
+
+    /** Writes 2 * numInput samples. Zero-stuffing means the even outputs only see the even taps, and the odd outputs
+     *  only see the centre tap, which is a plain delay */
+    void process(const float* input, int numInput, float* output) {
+        auto& h = HalfBand::coefficients();
+        auto* x = work.data() + HISTORY;
+        std::copy(input, input + numInput, x);
+
+        for (int m = 0; m < numInput; m++) {
+            auto sum = 0.0f;
+            for (int k = 0; k < HalfBand::TAPS; k += 2) {
+                sum += h[(size_t) k] * x[m - k / 2];
+            }
+            output[2 * m] = 2.0f * sum;
+            output[2 * m + 1] = x[m - (HalfBand::CENTRE - 1) / 2];
+        }
+
+        std::copy(x + numInput - HISTORY, x + numInput, work.data());
+    }
+};
+
+/** Runs part of a stereo signal path at a half or a quarter of the rate: the input goes down through one or two
+ *  half-band decimators, gets processed, and comes back up through matching interpolators. Everything is allocated in
+ *  prepare.
+ *
+ *  Host blocks don't have to be a multiple of the factor; whatever is left over waits for the next block. The output
+ *  queue starts with factor - 1 samples of silence to cover that wait, which lines up exactly with the centre of the
+ *  filters, so it adds nothing to the latency. */
+class ReducedRateProcessor {
+    private:
+    int stages = 1;
+    int factor = 2;
+
+    std::array<std::array<HalfBandDecimator, 2>, 2> decimators;     // [channel][stage]
+    std::array<std::array<HalfBandInterpolator, 2>, 2> interpolators;
+
+    /** Input waiting to make up a whole multiple of the factor */
+    AudioBuffer<float> pending;
+    int numPending = 0;
+
+    /** Between the two stages when going down by four */
+    AudioBuffer<float> intermediate;
+    AudioBuffer<float> lowRate;
+
+    /** Output waiting to be handed back */
+    AudioBuffer<float> queue;
+    int numQueued = 0;
+
+    public:
+    void prepare(int numStages, int maxBlockSize) {
+        stages = jlimit(1, 2, numStages);
+        factor = 1 << stages;
+        auto capacity = maxBlockSize + factor;
+
+        pending.setSize(2, capacity);
+        intermediate.setSize(2, capacity / 2 + 1);
+        lowRate.setSize(2, capacity / factor + 1);
+        queue.setSize(2, capacity + factor);
+
+        for (auto& channel: decimators) {
+            channel[0].prepare(capacity);
+            channel[1].prepare(capacity / 2);
+        }
+        for (auto& channel: interpolators) {
+            channel[0].prepare(capacity / 2);
+            channel[1].prepare(capacity / 4);
+        }
+        reset();
+    }
+
+    void reset() {
+        for (int c = 0; c < 2; c++) {
+            for (int s = 0; s < 2; s++) {
+                decimators[(size_t) c][(size_t) s].reset();
+                interpolators[(size_t) c][(size_t) s].reset();
+            }
+        }
+        pending.clear();
+        queue.clear();
+        numPending = 0;
+        numQueued = factor - 1;
+    }
+
+    int getFactor() const {
+        return factor;
+    }
+
+    /** How far the output lags the input, in samples at the full rate */
+    int getLatency() const {
+        return HalfBand::ROUND_TRIP_LATENCY * (factor - 1);
+    }
+
+    /** Takes the (stereo) input down, hands it to processLowRate as an AudioBlock to process in place, and writes the
+     *  result back at the full rate to the start of output */
+    template <typename LowRateProcess>
+    void process(const dsp::AudioBlock<float>& input, AudioBuffer<float>& output, LowRateProcess&& processLowRate) {
+        auto n = (int) input.getNumSamples();
+        auto total = numPending + n;
+        auto usable = total - total % factor;
+        auto numLow = usable / factor;
+
+        for (int c = 0; c < 2; c++) {
+            auto* in = pending.getWritePointer(c);
+            std::copy(input.getChannelPointer((size_t) c), input.getChannelPointer((size_t) c) + n, in + numPending);
+
+            if (stages == 1) {
+                decimators[(size_t) c][0].process(in, usable, lowRate.getWritePointer(c));
+            } else {
+                decimators[(size_t) c][0].process(in, usable, intermediate.getWritePointer(c));
+                decimators[(size_t) c][1].process(intermediate.getReadPointer(c), usable / 2, lowRate.getWritePointer(c));
+            }
+        }
+
+        if (numLow > 0) {
+            processLowRate(dsp::AudioBlock<float>(lowRate).getSubBlock(0, (size_t) numLow));
+        }
+
+        for (int c = 0; c < 2; c++) {
+            auto* out = queue.getWritePointer(c) + numQueued;
+            if (stages == 1) {
+                interpolators[(size_t) c][0].process(lowRate.getReadPointer(c), numLow, out);
+            } else {
+                interpolators[(size_t) c][1].process(lowRate.getReadPointer(c), numLow, intermediate.getWritePointer(c));
+                interpolators[(size_t) c][0].process(intermediate.getReadPointer(c), usable / 2, out);
+            }
+
+            auto* in = pending.getWritePointer(c);
+            std::copy(in + usable, in + total, in);
+
+            auto* queued = queue.getWritePointer(c);
+            std::copy(queued, queued + n, output.getWritePointer(c));
+            std::copy(queued + n, queued + numQueued + usable, queued);
+        }
+
+        numPending = total - usable;
+        numQueued += usable - n;
+    }
+};
+
+/** A short fixed delay to keep a full-rate dry signal lined up with one that has been through a ReducedRateProcessor */
+class DelayCompensation {
+    private:
+    AudioBuffer<float> buffer;
+    int writeIndex = 0;
+    int delay = 0;
+
+    public:
+    void prepare(int maxDelay) {
+        buffer.setSize(2, maxDelay + 1);
+        reset();
+    }
+
+    void reset() {
+        buffer.clear();
+        writeIndex = 0;
+    }
+
+    void setDelay(int newDelay) {
+        delay = jlimit(0, buffer.getNumSamples() - 1, newDelay);
+    }
+
+    void process(dsp::AudioBlock<float>& block) {
+        auto size = buffer.getNumSamples();
+        auto n = (int) block.getNumSamples();
+        auto startIndex = writeIndex;
+        for (int c = 0; c < 2; c++) {
+            auto* data = block.getChannelPointer((size_t) c);
+            auto* line = buffer.getWritePointer(c);
+            auto w = startIndex;
+            for (int i = 0; i < n; i++) {
+                line[w] = data[i];
+                auto r = w - delay;
+                data[i] = line[r < 0 ? r + size : r];
+                w = w + 1 == size ? 0 : w + 1;
+            }
+            writeIndex = w;
+        }
+    }
+};
+
+/** Lets the reverb and phaser run at reduced rate to save CPU. The user picks a setting, and a CPU governor can force
+ *  a more economical one on top of that - whichever saves more wins */
+class EcoMode : public AudioProcessorValueTreeState::Listener {
+    private:
+    std::atomic<int> setting { 0 };
+    std::atomic<int> governorSetting { 0 };
+
+    void parameterChanged(const String& parameterID, float newValue) override {
+        if (parameterID == CryptParameters::EcoMode) {
+            setting = jlimit(0, 2, roundToInt(newValue));
+        }
+    }
+
+    public:
+    static std::vector<ParameterSpec> params() {
+        return {
+            {.id = CryptParameters::EcoMode, .name = "Eco Mode", .range = {0.0, 2.0, 1.0}, .def = 0.0f,
+                .choices = {"Off", "Half", "Quarter"}},
+        };
+    }
+
+    void registerParams(AudioProcessorValueTreeState& state) {
+        listenToParams(state, params(), this);
+    }
+
+    void unRegisterParams(AudioProcessorValueTreeState& state) {
+        for (auto p: params()) {
+            state.removeParameterListener(p.id, this);
+        }
+    }
+
+    /** 0 to leave it to the user, 1 for at least half rate, 2 for quarter rate. Safe to call from any thread */
+    void setGovernorSetting(int newSetting) {
+        governorSetting = jlimit(0, 2, newSetting);
+    }
+
+    /** Number of halvings of the rate to run at (0, 1 or 2) */
+    int getStages() const {
+        return jmax(setting.load(), governorSetting.load());
+    }
+};
@@ -46,9 +46,7 @@ class ParameterControlledADSR: public ADSR, public AudioProcessorValueTreeState:
     }
 
     void registerParams(AudioProcessorValueTreeState& state) {
-        for (auto p: params(idPrefix)) {
-            state.addParameterListener(p.id, this);
-        }
+        listenToParams(state, params(idPrefix), this);
     }
     void unRegisterParams(AudioProcessorValueTreeState& state) {
         for (auto p: params(idPrefix)) {
@@ -0,0 +1,151 @@
+/*
+    Copyright 2025 David Whiting
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <JuceHeader.h>
+#include "CryptParameters.hpp"
+#include "CustomParameterModel.hpp"
+#include "SineTable.hpp"
+
+/** One row of the modulation matrix: how far an LFO at full swing pushes each of the things it can modulate */
+struct ModulationAmounts {
+    float cutoff = 0.0f; // octaves
+    float spread = 0.0f;
+    float shape = 0.0f;
+    float dirt = 0.0f;
+    float width = 0.0f;  // proportion of the unison stereo width taken away at the top of the cycle
+};
+
+/** A sine LFO along with its row of the modulation matrix. LFOs are only ever evaluated at control rate, once every
+ *  few dozen samples, rather than per sample */
+class ParameterControlledLFO : public AudioProcessorValueTreeState::Listener {
+    private:
+    String idPrefix;
+    float rate;
+    ModulationAmounts amounts;
+
+    /** Position in the cycle, 0 to 1 */
+    float phase = 0.0f;
+
+    SharedResourcePointer<SineTable> sine;
+
+    public:
+    ParameterControlledLFO(String idPrefix, float defaultRate): idPrefix(idPrefix), rate(defaultRate) {}
+
+    static std::vector<ParameterSpec> params(String idPrefix, float defaultRate) {
+        return {
+            {.id = idPrefix + "." + CryptParameters::LfoRate, .name = "Rate", .range = {0.01, 20.0, 0.01, 0.3}, .def = defaultRate},
+            {.id = idPrefix + "." + CryptParameters::Cutoff, .name = "To Cutoff", .range = {-4.0, 4.0, 0.01}, .def = 0.0f},
+            {.id = idPrefix + "." + CryptParameters::Spread, .name = "To Spread", .range = {-0.1, 0.1, 0.001}, .def = 0.0f},
+            {.id = idPrefix + "." + CryptParameters::Shape, .name = "To Shape", .range = {-1.0, 1.0, 0.01}, .def = 0.0f},
+            {.id = idPrefix + "." + CryptParameters::Dirt, .name = "To Dirt", .range = {-1.0, 1.0, 0.01}, .def = 0.0f},
+            {.id = idPrefix + "." + CryptParameters::Width, .name = "To Width", .range = {0.0, 1.0, 0.01}, .def = 0.0f},
+        };
+    }
+
+    void registerParams(AudioProcessorValueTreeState& state) {
+        listenToParams(state, params(idPrefix, rate), this);
+    }
+
+    void unRegisterParams(AudioProcessorValueTreeState& state) {
+        for (auto p: params(idPrefix, rate)) {
+            state.removeParameterListener(p.id, this);
+        }
+    }
+
+    void parameterChanged(const String& parameterID, float newValue) override {
+        if (parameterID.endsWith(CryptParameters::LfoRate)) {
+            rate = newValue;
+        } else if (parameterID.endsWith(CryptParameters::Cutoff)) {
+            amounts.cutoff = newValue;
+        } else if (parameterID.endsWith(CryptParameters::Spread)) {
+            amounts.spread = newValue;
+        } else if (parameterID.endsWith(CryptParameters::Shape)) {
+            amounts.shape = newValue;
+        } else if (parameterID.endsWith(CryptParameters::Dirt)) {
+            amounts.dirt = newValue;
+        } else if (parameterID.endsWith(CryptParameters::Width)) {
+            amounts.width = newValue;
+        }
+    }
+
+    const ModulationAmounts& getAmounts() const {
+        return amounts;
+    }
+
+    void retrigger() {
+        phase = 0.0f;
+    }
+
+    /** Value of the LFO (-1 to 1) for the next control period, which is then stepped on by numSamples */
+    float tick(int numSamples, double sampleRate) {
+        auto value = sine->lookup(phase);
+        phase += (float) (rate * numSamples / sampleRate);
+        phase -= std::floor(phase);
+        return value;
+    }
+};
+
+/** The global LFO is shared by every voice, so it's evaluated once per block ahead of the synth, and each voice just
+ *  looks up the value for wherever it is in the block */
+class GlobalModulation {
+    private:
+    static constexpr float DEFAULT_RATE = 0.2f;
+
+    ParameterControlledLFO lfo { CryptParameters::GlobalLfo, DEFAULT_RATE };
+
+    /** One value per control period of the current block */
+    std::vector<float> values;
+
+    public:
+    static constexpr int CONTROL_INTERVAL = 32;
+
+    static std::vector<ParameterSpec> params() {
+        return ParameterControlledLFO::params(CryptParameters::GlobalLfo, DEFAULT_RATE);
+    }
+
+    void registerParams(AudioProcessorValueTreeState& state) {
+        lfo.registerParams(state);
+    }
+
+    void unRegisterParams(AudioProcessorValueTreeState& state) {
+        lfo.unRegisterParams(state);
+    }
+
+    /** maxSamplesPerBlock is in samples at the rate the synth runs, which may be oversampled */
+    void prepare(int maxSamplesPerBlock) {
+        values.assign((size_t) (maxSamplesPerBlock / CONTROL_INTERVAL + 2), 0.0f);
+    }
+
+    /** Call once per block before rendering the synth, with the synth's block size and sample rate */
+    void advance(int numSamples, double sampleRate) {
+        auto ticks = jmin((int) values.size(), (numSamples + CONTROL_INTERVAL - 1) / CONTROL_INTERVAL);
+        for (int t = 0; t < ticks; t++) {
+            values[(size_t) t] = lfo.tick(jmin(CONTROL_INTERVAL, numSamples - t * CONTROL_INTERVAL), sampleRate);
+        }
+    }
+
+    float getValueAt(int sample) const {
+        if (values.empty()) {
+            return 0.0f;
+        }
+        return values[(size_t) jmin(sample / CONTROL_INTERVAL, (int) values.size() - 1)];
+    }
+
+    const ModulationAmounts& getAmounts() const {
+        return lfo.getAmounts();
+    }
+};
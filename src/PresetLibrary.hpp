@@ -0,0 +1,370 @@
+/*
+    Copyright 2025 David Whiting
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <JuceHeader.h>
+#include "CryptAudioProcessor.hpp"
+
+/** One .crypt file in the library, with everything the browser needs so that it never has to open the file */
+struct LibraryPreset {
+    /** Relative to the library folder */
+    String path;
+    int64 modified = 0;
+    String name;
+    /** The folders it's in, plus anything in a "tags" attribute on the state */
+    StringArray tags;
+    String impulseResponsePath;
+    std::vector<std::pair<String, float>> values;
+    /** The audition clip, if it's been rendered yet */
+    File preview;
+
+    /** Parameters which aren't in the file, and settings which aren't part of a preset, are left as they are */
+    ParameterSnapshot toSnapshot(AudioProcessorValueTreeState& state) const {
+        auto& parameters = state.processor.getParameters();
+        ParameterSnapshot snapshot((size_t) parameters.size(), std::numeric_limits<float>::quiet_NaN());
+        for (auto& [id, value]: values) {
+            auto* parameter = state.getParameter(id);
+            if (parameter != nullptr && ! PresetManager::isPresetIndependent(id)) {
+                snapshot[(size_t) parameter->getParameterIndex()] = parameter->convertTo0to1(value);
+            }
+        }
+        return snapshot;
+    }
+};
+
+/** Every preset in the library, as of the last scan. Never changes once published */
+using LibraryIndex = std::vector<LibraryPreset>;
+
+/** The user's preset folder, indexed on a background thread.
+ *
+ *  The index is kept in a binary cache file, so when the browser opens it has everything straight away from the last
+ *  run. The folder is then scanned whenever a browser opens or a preset is saved, and otherwise polled about once a
+ *  minute, as JUCE has no portable way of being told about changes; only new or modified files get parsed. After each
+ *  scan, any preset without an audition clip gets one rendered by a headless instance of the plugin, and stored
+ *  alongside the cache.
+ *
+ *  Shared between all instances through a SharedResourcePointer, and tells listeners on the message thread whenever the
+ *  index changes.
+ */
+class PresetLibrary : public ChangeBroadcaster, private Thread {
+    private:
+    static constexpr int CACHE_MAGIC = 0x4c505243;  // "CRPL"
+    static constexpr int CACHE_VERSION = 1;
+    static constexpr int POLL_INTERVAL_MS = 60000;
+    /** While clips are being rendered, the index is republished with the new ones at most this often */
+    static constexpr double PUBLISH_INTERVAL_MS = 1000.0;
+
+    static constexpr double PREVIEW_RATE = 44100.0;
+    static constexpr int PREVIEW_BLOCK = 512;
+    static constexpr double PREVIEW_NOTE_SECONDS = 1.5;
+    static constexpr double PREVIEW_SECONDS = 3.0;
+
+    File folder;
+    File cacheFolder;
+
+    /** Presets whose clips couldn't be rendered, so they aren't retried on every pass. Library thread only */
+    std::set<String> failedPreviews;
+
+    /** A headless instance of the whole plugin, so the clips sound exactly like the presets will; the voices and FX
+     *  all read their settings from its parameters. Made for the first clip and reused for the rest, and costs nothing
+     *  between renders. Library thread only */
+    std::unique_ptr<CryptAudioProcessor> renderer;
+
+    /** Set by rescan(), so a long run of rendering stops to look at the folder first */
+    std::atomic<bool> rescanRequested { false };
+
+    CriticalSection lock;
+    std::shared_ptr<const LibraryIndex> index = std::make_shared<const LibraryIndex>();
+
+    File getCacheFile() const {
+        return cacheFolder.getChildFile("index.bin");
+    }
+
+    File getPreviewFile(const LibraryPreset& preset) const {
+        return cacheFolder.getChildFile("previews").getChildFile(String::toHexString(preset.path.hashCode64()) + ".wav");
+    }
+
+    void publish(std::shared_ptr<const LibraryIndex> newIndex) {
+        {
+            const ScopedLock sl(lock);
+            index = std::move(newIndex);
+        }
+        sendChangeMessage();
+    }
+
+    void writeCache(const LibraryIndex& presets) {
+        MemoryOutputStream out;
+        out.writeInt(CACHE_MAGIC);
+        out.writeInt(CACHE_VERSION);
+        out.writeInt((int) presets.size());
+        for (auto& preset: presets) {
+            out.writeString(preset.path);
+            out.writeInt64(preset.modified);
+            out.writeString(preset.name);
+            out.writeString(preset.tags.joinIntoString(","));
+            out.writeString(preset.impulseResponsePath);
+            out.writeInt((int) preset.values.size());
+            for (auto& [id, value]: preset.values) {
+                out.writeString(id);
+                out.writeFloat(value);
+            }
+        }
+        cacheFolder.createDirectory();
+        getCacheFile().replaceWithData(out.getData(), out.getDataSize());
+    }
+
+    LibraryIndex readCache() const {
+        LibraryIndex presets;
+        MemoryBlock data;
+        if (! getCacheFile().loadFileAsData(data) || data.getSize() < 12) {
+            return presets;
+        }
+
+        MemoryInputStream in(data, false);
+        if (in.readInt() != CACHE_MAGIC || in.readInt() != CACHE_VERSION) {
+            return presets;
+        }
+        auto count = in.readInt();
+        for (int i = 0; i < count && ! in.isExhausted(); i++) {
+            LibraryPreset preset;
+            preset.path = in.readString();
+            preset.modified = in.readInt64();
+            preset.name = in.readString();
+            preset.tags.addTokens(in.readString(), ",", "");
+            preset.tags.removeEmptyStrings();
+            preset.impulseResponsePath = in.readString();
+            auto numValues = in.readInt();
+            for (int v = 0; v < numValues && ! in.isExhausted(); v++) {
+                auto id = in.readString();
+                preset.values.emplace_back(id, in.readFloat());
+            }
+            presets.push_back(std::move(preset));
+        }
+        return presets;
+    }
+
+    /** Returns nullptr if nothing has changed since the current index */
+    std::shared_ptr<LibraryIndex> scan(const LibraryIndex& current) {
+        std::map<String, const LibraryPreset*> known;
+        for (auto& preset: current) {
+            known[preset.path] = &preset;
+        }
+
+        auto updated = std::make_shared<LibraryIndex>();
+        auto changed = false;
+        for (auto& entry: RangedDirectoryIterator(folder, true, "*.crypt", File::findFiles)) {
+            if (threadShouldExit()) {
+                return nullptr;
+            }
+            auto file = entry.getFile();
+            auto path = file.getRelativePathFrom(folder);
+            auto existing = known.find(path);
+            if (existing != known.end() && existing->second->modified == entry.getModificationTime().toMilliseconds()) {
+                updated->push_back(*existing->second);
+            } else if (auto parsed = parse(file, folder)) {
+                updated->push_back(std::move(*parsed));
+                changed = true;
+            }
+        }
+        changed = changed || updated->size() != current.size();
+        if (! changed) {
+            return nullptr;
+        }
+
+        std::sort(updated->begin(), updated->end(), [] (const LibraryPreset& a, const LibraryPreset& b) {
+            return a.name.compareNatural(b.name) < 0;
+        });
+        return updated;
+    }
+
+    /** Plays a chord through the renderer with the preset loaded, and saves it as a wav */
+    bool renderPreview(const LibraryPreset& preset, const File& destination) {
+        if (renderer == nullptr) {
+            renderer = std::make_unique<CryptAudioProcessor>(CryptAudioProcessor::Mode::headless);
+            renderer->prepareToPlay(PREVIEW_RATE, PREVIEW_BLOCK);
+        }
+
+        // Silent and back to the defaults, so nothing of the last preset carries over into this one
+        renderer->reset();
+        auto& parameters = renderer->getParameters();
+        auto snapshot = preset.toSnapshot(renderer->state);
+        for (size_t i = 0; i < snapshot.size(); i++) {
+            if (std::isnan(snapshot[i])) {
+                snapshot[i] = parameters[(int) i]->getDefaultValue();
+            }
+        }
+        applySnapshot(parameters, snapshot);
+
+        const int chord[] = { 48, 55, 60, 63 };
+        for (auto note: chord) {
+            renderer->injectMidi(MidiMessage::noteOn(1, note, 0.8f));
+        }
+
+        auto total = (int) (PREVIEW_RATE * PREVIEW_SECONDS);
+        auto noteOff = (int) (PREVIEW_RATE * PREVIEW_NOTE_SECONDS);
+        AudioBuffer<float> clip(2, total);
+        MidiBuffer noMidi;
+        for (int start = 0; start < total; start += PREVIEW_BLOCK) {
+            if (threadShouldExit()) {
+                return false;
+            }
+            if (start <= noteOff && noteOff < start + PREVIEW_BLOCK) {
+                for (auto note: chord) {
+                    renderer->injectMidi(MidiMessage::noteOff(1, note), noteOff - start);
+                }
+            }
+            AudioBuffer<float> block(clip.getArrayOfWritePointers(), 2, start, jmin(PREVIEW_BLOCK, total - start));
+            renderer->processBlock(block, noMidi);
+        }
+
+        // Written to the side and moved into place, so nothing ever reads half a file
+        auto temporary = destination.getSiblingFile(destination.getFileName() + ".tmp");
+        destination.getParentDirectory().createDirectory();
+        temporary.deleteFile();
+        {
+            auto stream = temporary.createOutputStream();
+            if (stream == nullptr) {
+                return false;
+            }
+            WavAudioFormat wav;
+            std::unique_ptr<AudioFormatWriter> writer(wav.createWriterFor(stream.get(), PREVIEW_RATE, 2, 16, {}, 0));
+            if (writer == nullptr) {
+                return false;
+            }
+            stream.release();
+            writer->writeFromAudioSampleBuffer(clip, 0, total);
+        }
+        return temporary.moveFileTo(destination);
+    }
+
+    /** Renders the missing clips, until they're done or a rescan is asked for. The index is only copied and
+     *  published once for each batch of clips rendered in PUBLISH_INTERVAL_MS, rather than for every one */
+    void renderPreviews() {
+        auto current = getIndex();
+        std::shared_ptr<LibraryIndex> updated;
+        auto lastPublish = Time::getMillisecondCounterHiRes();
+
+        for (size_t i = 0; i < current->size() && ! threadShouldExit() && ! rescanRequested; i++) {
+            auto& preset = (*current)[i];
+            if (preset.preview != File() || failedPreviews.count(preset.path) > 0) {
+                continue;
+            }
+            auto destination = getPreviewFile(preset);
+            if (! renderPreview(preset, destination)) {
+                if (! threadShouldExit()) {
+                    failedPreviews.insert(preset.path);
+                }
+                continue;
+            }
+
+            if (updated == nullptr) {
+                updated = std::make_shared<LibraryIndex>(*current);
+            }
+            (*updated)[i].preview = destination;
+
+            auto now = Time::getMillisecondCounterHiRes();
+            if (now - lastPublish >= PUBLISH_INTERVAL_MS) {
+                // Published indexes never change, so the next clip goes into a new copy
+                current = updated;
+                publish(std::move(updated));
+                lastPublish = now;
+            }
+        }
+
+        if (updated != nullptr) {
+            publish(std::move(updated));
+        }
+    }
+
+    /** Fills in the clips that have already been rendered for the current version of each preset */
+    void findPreviews(LibraryIndex& presets) const {
+        for (auto& preset: presets) {
+            auto file = getPreviewFile(preset);
+            preset.preview = file.getLastModificationTime().toMilliseconds() >= preset.modified ? file : File();
+        }
+    }
+
+    void run() override {
+        auto cached = std::make_shared<LibraryIndex>(readCache());
+        findPreviews(*cached);
+        publish(cached);
+
+        while (! threadShouldExit()) {
+            rescanRequested = false;
+            folder.createDirectory();
+            if (auto updated = scan(*getIndex())) {
+                findPreviews(*updated);
+                writeCache(*updated);
+                publish(std::move(updated));
+            }
+            renderPreviews();
+            wait(POLL_INTERVAL_MS);
+        }
+    }
+
+    public:
+    /** Reads a .crypt file, with the folders between it and root as its tags. Returns nothing if it isn't a preset */
+    static std::optional<LibraryPreset> parse(const File& file, const File& root) {
+        auto xml = XmlDocument::parse(file);
+        if (xml == nullptr || ! xml->hasTagName("state")) {
+            return std::nullopt;
+        }
+
+        LibraryPreset preset;
+        preset.path = file.getRelativePathFrom(root);
+        preset.modified = file.getLastModificationTime().toMilliseconds();
+        preset.name = file.getFileNameWithoutExtension();
+        for (auto parent = file.getParentDirectory(); parent != root && parent.isAChildOf(root);
+             parent = parent.getParentDirectory()) {
+            preset.tags.add(parent.getFileName());
+        }
+        preset.tags.addTokens(xml->getStringAttribute("tags"), ",", "");
+        preset.tags.trim();
+        preset.tags.removeEmptyStrings();
+        preset.impulseResponsePath = xml->getStringAttribute(CryptParameters::ImpulseResponsePath);
+        for (auto* param: xml->getChildWithTagNameIterator("PARAM")) {
+            preset.values.emplace_back(param->getStringAttribute("id"), (float) param->getDoubleAttribute("value"));
+        }
+        return preset;
+    }
+
+    PresetLibrary(): Thread("Crypt preset library") {
+        auto root = File::getSpecialLocation(File::userApplicationDataDirectory).getChildFile("Vitling").getChildFile("Crypt");
+        folder = root.getChildFile("Presets");
+        cacheFolder = root.getChildFile("Cache");
+        startThread();
+    }
+
+    ~PresetLibrary() override {
+        stopThread(10000);
+    }
+
+    File getFolder() const {
+        return folder;
+    }
+
+    /** Safe to call from any thread; the index it returns stays valid for as long as it's held */
+    std::shared_ptr<const LibraryIndex> getIndex() const {
+        const ScopedLock sl(lock);
+        return index;
+    }
+
+    /** Look for changes now rather than at the next poll, eg. after saving a preset into the folder */
+    void rescan() {
+        rescanRequested = true;
+        notify();
+    }
+};
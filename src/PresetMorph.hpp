@@ -0,0 +1,211 @@
+/*
+    Copyright 2025 David Whiting
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <JuceHeader.h>
+#include "CryptParameters.hpp"
+#include "SharedBuffer.hpp"
+
+/** A normalised value for each parameter, by parameter index. NaN means the snapshot leaves that parameter alone */
+using ParameterSnapshot = std::vector<float>;
+
+/** Sets every parameter the snapshot covers, skipping the ones that are already there so their listeners don't fire
+ *  for nothing. Values are snapped to each parameter's steps, so a switch or a choice never ends up in between */
+inline void applySnapshot(const Array<AudioProcessorParameter*>& parameters, const ParameterSnapshot& snapshot) {
+    auto count = jmin(parameters.size(), (int) snapshot.size());
+    for (int i = 0; i < count; i++) {
+        auto value = snapshot[(size_t) i];
+        auto* parameter = dynamic_cast<RangedAudioParameter*>(parameters[i]);
+        if (std::isnan(value) || parameter == nullptr) {
+            continue;
+        }
+        auto& range = parameter->getNormalisableRange();
+        auto normalised = range.convertTo0to1(range.snapToLegalValue(range.convertFrom0to1(value)));
+        if (normalised != parameter->getValue()) {
+            parameter->setValueNotifyingHost(normalised);
+        }
+    }
+}
+
+/** Switches presets from the audio thread, and morphs between two of them.
+ *
+ *  The message thread works out the snapshot for a preset and hands it over (newest wins, for each slot), and the
+ *  audio thread applies the whole thing at the start of a block. So the voices never render a block with half of one
+ *  preset and half of another, and only the parameters that differ get touched.
+ *
+ *  The current preset is one end of the morph and the morph target, once one has been chosen, is the other. Whenever
+ *  the Morph parameter moves, every parameter either preset covers is set in between the two, once per block. In
+ *  between moves the parameters are left alone, so they can still be tweaked by hand, and without a target moving the
+ *  Morph does nothing at all.
+ *
+ *  The audio thread only sets the parameters' values, which goes straight to the components listening to them
+ *  (see createParameterGroup). It marks the ones it changed, and a timer on the message thread tells the host and the
+ *  editor about them, so nothing on the audio thread ever posts a message.
+ */
+class PresetMorph: private Timer {
+    public:
+    enum Slot { current = 0, target = 1 };
+
+    private:
+    static constexpr int REPORT_INTERVAL_MS = 30;
+
+    struct Handoff {
+        ParameterSnapshot values;
+        /** False for an empty slot, eg. no target chosen */
+        bool present;
+        /** False when the caller has already applied it, and it's only there as the end of the morph */
+        bool apply;
+    };
+
+    const Array<AudioProcessorParameter*>& parameters;
+    std::atomic<float>* morph;
+
+    std::array<std::unique_ptr<TripleBuffer<Handoff>>, 2> handoffs;
+
+    /** Parameters the audio thread has changed, which the host hasn't been told about yet */
+    std::unique_ptr<std::atomic<bool>[]> unreported;
+    std::atomic<bool> anyUnreported { false };
+
+    /** Set while the whole state is being replaced, so that the audio thread doesn't morph over the top of it */
+    std::atomic<bool> suspended { false };
+
+    // Audio thread only
+    std::array<bool, 2> hasSnapshot { false, false };
+    ParameterSnapshot blended;
+    float appliedMorph = 0.0f;
+
+    /** Time of the last block, so that nothing is left waiting for an audio thread that isn't running */
+    std::atomic<uint32> lastProcessTime { 0 };
+
+    public:
+    /** Without reportChanges nobody is ever told what the audio thread changed, which is only any use headless */
+    PresetMorph(AudioProcessorValueTreeState& state, bool reportChanges)
+            : parameters(state.processor.getParameters()),
+              morph(state.getRawParameterValue(CryptParameters::Morph)) {
+        auto size = (size_t) parameters.size();
+        for (auto& handoff: handoffs) {
+            handoff = std::make_unique<TripleBuffer<Handoff>>(
+                    Handoff { ParameterSnapshot(size, std::numeric_limits<float>::quiet_NaN()), false, false });
+        }
+        blended.resize(size);
+        unreported = std::make_unique<std::atomic<bool>[]>(size);
+        if (reportChanges) {
+            startTimer(REPORT_INTERVAL_MS);
+        }
+    }
+
+    ~PresetMorph() override {
+        stopTimer();
+    }
+
+    /** Message thread only. An empty snapshot clears the slot. Returns false if the audio thread isn't going to pick
+     *  it up any time soon (because it isn't running), in which case it's up to the caller to apply the snapshot
+     *  directly. It's still kept as that end of the morph, but it won't be applied again over the top of later changes
+     *  when the audio starts again. The same goes for a snapshot of what the parameters are already set to, which is
+     *  only ever kept */
+    bool push(Slot slot, const ParameterSnapshot& values, bool alreadyApplied = false) {
+        auto running = Time::getMillisecondCounter() - lastProcessTime.load() < 200;
+
+        auto& handoff = handoffs[slot]->getBack();
+        std::fill(handoff.values.begin(), handoff.values.end(), std::numeric_limits<float>::quiet_NaN());
+        std::copy(values.begin(), values.begin() + (ptrdiff_t) jmin(values.size(), handoff.values.size()),
+                  handoff.values.begin());
+        handoff.present = ! values.empty();
+        handoff.apply = running && ! alreadyApplied;
+        handoffs[slot]->publish();
+        return running;
+    }
+
+    /** Message thread only. Stops the audio thread from touching the parameters while the whole state is replaced,
+     *  until the new ends of the morph have been pushed and it's resumed */
+    void setSuspended(bool shouldBeSuspended) {
+        suspended = shouldBeSuspended;
+    }
+
+    /** Audio thread only, at the start of each block before anything is rendered */
+    void process() {
+        lastProcessTime = Time::getMillisecondCounter();
+        if (suspended.load()) {
+            return;
+        }
+        auto amount = morph->load();
+
+        auto changed = false;
+        for (auto slot: { current, target }) {
+            if (handoffs[slot]->update()) {
+                auto& front = handoffs[slot]->getFront();
+                hasSnapshot[slot] = front.present;
+                // A new target only makes a difference if the morph is away from the current preset
+                changed = changed || (front.apply && front.present && (slot == current || amount > 0.0f));
+                // What's set now already matches the morph where it is
+                if (slot == current && ! front.apply) {
+                    appliedMorph = amount;
+                }
+            }
+        }
+
+        auto moved = amount != appliedMorph && hasSnapshot[target];
+        appliedMorph = amount;
+        if (! (changed || moved) || ! hasSnapshot[current]) {
+            return;
+        }
+
+        auto& from = handoffs[current]->getFront().values;
+        auto& to = handoffs[target]->getFront().values;
+        for (size_t i = 0; i < blended.size(); i++) {
+            auto a = from[i];
+            auto b = hasSnapshot[target] ? to[i] : a;
+            blended[i] = std::isnan(b) ? a : a + (b - a) * amount;
+        }
+        setWithoutNotifying();
+    }
+
+    private:
+    /** Like applySnapshot(), from the audio thread */
+    void setWithoutNotifying() {
+        auto count = jmin(parameters.size(), (int) blended.size());
+        auto anyChanged = false;
+        for (int i = 0; i < count; i++) {
+            auto value = blended[(size_t) i];
+            auto* parameter = dynamic_cast<RangedAudioParameter*>(parameters[i]);
+            if (std::isnan(value) || parameter == nullptr) {
+                continue;
+            }
+            auto& range = parameter->getNormalisableRange();
+            auto normalised = range.convertTo0to1(range.snapToLegalValue(range.convertFrom0to1(value)));
+            if (normalised != parameter->getValue()) {
+                parameter->setValue(normalised);
+                unreported[(size_t) i] = true;
+                anyChanged = true;
+            }
+        }
+        if (anyChanged) {
+            anyUnreported = true;
+        }
+    }
+
+    /** The values are already set, so this only tells the host and the editor's controls */
+    void timerCallback() override {
+        if (! anyUnreported.exchange(false)) {
+            return;
+        }
+        for (int i = 0; i < parameters.size(); i++) {
+            if (unreported[(size_t) i].exchange(false)) {
+                parameters[i]->sendValueChangedMessageToListeners(parameters[i]->getValue());
+            }
+        }
+    }
+};
@@ -0,0 +1,140 @@
+/*
+    Copyright 2025 David Whiting
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <JuceHeader.h>
+
+/** Plays the audition clips from the preset browser over the top of the plugin's output.
+ *
+ *  Clips are read and resampled to the current rate on a background thread, then handed over under a SpinLock which
+ *  the audio thread only ever tries to take, so if it's busy the clip just starts a block later. The audio thread never
+ *  frees a clip either: the one it stops playing is parked until the next handover, and released there.
+ */
+class PreviewPlayer {
+    private:
+    using Clip = std::shared_ptr<const AudioBuffer<float>>;
+
+    static constexpr float GAIN = 0.7f;
+
+    /** Both only created the first time something is auditioned, as most instances never will */
+    std::unique_ptr<AudioFormatManager> formats;
+    std::unique_ptr<ThreadPool> loader;
+    std::atomic<double> sampleRate { 44100.0 };
+
+    SpinLock lock;
+    // Guarded by lock
+    Clip pending;
+    bool hasPending = false;
+    Clip retired;
+
+    // Audio thread only
+    Clip playing;
+    int position = 0;
+
+    void handOver(Clip clip) {
+        Clip released;
+        {
+            const SpinLock::ScopedLockType sl(lock);
+            released = std::move(retired);
+            pending = std::move(clip);
+            hasPending = true;
+        }
+        // The previous clip goes out of scope here, outside the lock
+    }
+
+    Clip readClip(const File& file) {
+        std::unique_ptr<AudioFormatReader> reader(formats->createReaderFor(file));
+        if (reader == nullptr || reader->lengthInSamples <= 0) {
+            return nullptr;
+        }
+
+        auto length = (int) reader->lengthInSamples;
+        AudioBuffer<float> source(2, length);
+        reader->read(&source, 0, length, 0, true, true);
+
+        auto ratio = reader->sampleRate / sampleRate.load();
+        if (approximatelyEqual(ratio, 1.0)) {
+            return std::make_shared<const AudioBuffer<float>>(std::move(source));
+        }
+
+        auto resampledLength = (int) (length / ratio);
+        auto clip = std::make_shared<AudioBuffer<float>>(2, resampledLength);
+        for (int c = 0; c < 2; c++) {
+            LagrangeInterpolator interpolator;
+            interpolator.process(ratio, source.getReadPointer(c), clip->getWritePointer(c), resampledLength,
+                                 length, 0);
+        }
+        return clip;
+    }
+
+    public:
+    ~PreviewPlayer() {
+        if (loader != nullptr) {
+            loader->removeAllJobs(true, 1000);
+        }
+    }
+
+    void prepare(double newSampleRate) {
+        sampleRate = newSampleRate;
+    }
+
+    /** Start playing a clip from the beginning, once it's been read. Message thread only */
+    void play(const File& file) {
+        if (loader == nullptr) {
+            formats = std::make_unique<AudioFormatManager>();
+            formats->registerBasicFormats();
+            loader = std::make_unique<ThreadPool>(1);
+        }
+        loader->removeAllJobs(true, 0);
+        loader->addJob([this, file] {
+            if (auto clip = readClip(file)) {
+                handOver(std::move(clip));
+            }
+        });
+    }
+
+    /** Message thread only */
+    void stop() {
+        if (loader != nullptr) {
+            loader->removeAllJobs(true, 0);
+        }
+        handOver(nullptr);
+    }
+
+    /** Audio thread only. Adds whatever's playing into the output */
+    void process(AudioBuffer<float>& audio) {
+        {
+            const SpinLock::ScopedTryLockType tl(lock);
+            // Only take the new clip if the last retired one has been released, so nothing is freed here
+            if (tl.isLocked() && hasPending && retired == nullptr) {
+                retired = std::move(playing);
+                playing = std::move(pending);
+                hasPending = false;
+                position = 0;
+            }
+        }
+
+        if (playing == nullptr || position >= playing->getNumSamples()) {
+            return;
+        }
+
+        auto n = jmin(audio.getNumSamples(), playing->getNumSamples() - position);
+        for (int c = 0; c < audio.getNumChannels(); c++) {
+            audio.addFrom(c, 0, *playing, jmin(c, playing->getNumChannels() - 1), position, n, GAIN);
+        }
+        position += n;
+    }
+};
@@ -0,0 +1,161 @@
+/*
+    Copyright 2025 David Whiting
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <JuceHeader.h>
+#include "CryptParameters.hpp"
+#include "CustomParameterModel.hpp"
+
+/** Decides at what rate the synth voices are rendered. During live playback they run at the host rate like they
+ *  always have, but when the host bounces offline (where CPU doesn't matter) the voices are rendered at 4x or 8x and
+ *  brought back down through polyphase half-band filters, which gets rid of most of the aliasing from the naive
+ *  saw/square oscillators and the waveshaper.
+ *
+ *  The FX chain always runs at the host rate; it doesn't generate anything new above the voice bandwidth.
+ *
+ *  Changing the synth's rate stops every sounding note, so the rate is only ever picked in prepare or when the host
+ *  switches between realtime and offline processing. Moving the quality parameter in between takes effect at the next
+ *  of those, never in the middle of a render.
+ */
+class RenderQuality : public AudioProcessorValueTreeState::Listener {
+    private:
+    // Index of the OfflineQuality parameter -> number of 2x oversampling stages
+    static constexpr int OFFLINE_STAGES[] = { 0, 2, 3 };
+    static constexpr int NUM_SETTINGS = 3;
+
+    std::array<std::unique_ptr<dsp::Oversampling<float>>, NUM_SETTINGS> oversamplers;
+
+    /** MIDI timestamps need scaling into the oversampled block, this is preallocated in prepare */
+    MidiBuffer oversampledMidi;
+
+    std::atomic<int> offlineSetting { 1 };
+
+    // Audio thread only
+    int activeSetting = 0;
+    bool activeNonRealtime = false;
+    double baseSampleRate = 44100.0;
+
+    void parameterChanged(const String& parameterID, float newValue) override {
+        if (parameterID == CryptParameters::OfflineQuality) {
+            offlineSetting = jlimit(0, NUM_SETTINGS - 1, roundToInt(newValue));
+        }
+    }
+
+    int settingFor(bool isNonRealtime) const {
+        auto setting = isNonRealtime ? offlineSetting.load() : 0;
+        return oversamplers[(size_t) setting] != nullptr ? setting : 0;
+    }
+
+    void switchTo(Synthesiser& synth, int setting) {
+        activeSetting = setting;
+        synth.setCurrentPlaybackSampleRate(baseSampleRate * (1 << OFFLINE_STAGES[setting]));
+        if (oversamplers[(size_t) setting] != nullptr) {
+            oversamplers[(size_t) setting]->reset();
+        }
+    }
+
+    public:
+    static std::vector<ParameterSpec> params() {
+        return {
+            {.id = CryptParameters::OfflineQuality, .name = "Offline Render Quality", .range = {0.0, 2.0, 1.0}, .def = 1.0f,
+                .choices = {"Realtime", "4x", "8x"}},
+        };
+    }
+
+    void registerParams(AudioProcessorValueTreeState& state) {
+        listenToParams(state, params(), this);
+    }
+
+    void unRegisterParams(AudioProcessorValueTreeState& state) {
+        for (auto p: params()) {
+            state.removeParameterListener(p.id, this);
+        }
+    }
+
+    /** Allocates the oversamplers for every setting up front, so switching in and out of offline rendering never
+     *  allocates on the audio thread. Sets the synth to the rate for whichever mode the host is in. */
+    void prepare(Synthesiser& synth, double sampleRate, int samplesPerBlock, bool isNonRealtime) {
+        baseSampleRate = sampleRate;
+
+        for (int i = 1; i < NUM_SETTINGS; i++) {
+            oversamplers[i] = std::make_unique<dsp::Oversampling<float>>(
+                    2, OFFLINE_STAGES[i], dsp::Oversampling<float>::filterHalfBandPolyphaseIIR, true, false);
+            oversamplers[i]->initProcessing((size_t) samplesPerBlock);
+        }
+        oversampledMidi.ensureSize(4096);
+
+        activeNonRealtime = isNonRealtime;
+        switchTo(synth, settingFor(isNonRealtime));
+    }
+
+    /** How late the downsampling filters make the synth in the given mode, going by the quality it would switch to */
+    int getLatencySamples(bool isNonRealtime) const {
+        auto setting = settingFor(isNonRealtime);
+        if (setting == 0) {
+            return 0;
+        }
+        return roundToInt(oversamplers[(size_t) setting]->getLatencyInSamples());
+    }
+
+    void reset() {
+        for (auto& oversampler: oversamplers) {
+            if (oversampler != nullptr) {
+                oversampler->reset();
+            }
+        }
+    }
+
+    /** Return how many times the host rate the synth will run at for the coming block. The rate only changes here if
+     *  the host has switched between realtime and offline without preparing again */
+    int update(Synthesiser& synth, bool isNonRealtime) {
+        if (isNonRealtime != activeNonRealtime) {
+            activeNonRealtime = isNonRealtime;
+            auto setting = settingFor(isNonRealtime);
+            if (setting != activeSetting) {
+                switchTo(synth, setting);
+            }
+        }
+        return 1 << OFFLINE_STAGES[activeSetting];
+    }
+
+    /** Render the synth into audio (which is expected to be cleared) at the rate picked by the last update() */
+    void render(Synthesiser& synth, AudioBuffer<float>& audio, const MidiBuffer& midi) {
+        auto setting = activeSetting;
+        if (setting == 0) {
+            synth.renderNextBlock(audio, midi, 0, audio.getNumSamples());
+            return;
+        }
+
+        auto& oversampler = *oversamplers[setting];
+        auto factor = (int) oversampler.getOversamplingFactor();
+
+        // The input is silent, we only go up to get hold of the oversampler's internal buffer to render into
+        dsp::AudioBlock<float> block(audio);
+        auto upsampled = oversampler.processSamplesUp(block);
+        upsampled.clear();
+
+        oversampledMidi.clear();
+        for (const auto metadata: midi) {
+            oversampledMidi.addEvent(metadata.data, metadata.numBytes, metadata.samplePosition * factor);
+        }
+
+        float* channels[] = { upsampled.getChannelPointer(0), upsampled.getChannelPointer(1) };
+        AudioBuffer<float> upsampledAudio(channels, 2, (int) upsampled.getNumSamples());
+        synth.renderNextBlock(upsampledAudio, oversampledMidi, 0, upsampledAudio.getNumSamples());
+
+        oversampler.processSamplesDown(block);
+    }
+};
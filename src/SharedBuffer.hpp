@@ -17,57 +17,163 @@
 #pragma once
 #include <JuceHeader.h>
 
-/** Simple encapsulation of the FIFO buffer to communicate data from the audio thread to the GUI thread.
- *  I don't really actually understand it fully so I thought best to get it all inside here instead of
- *  spread around the rest of the code
+/** Hands the latest version of something from one thread to another, without either of them ever waiting.
+ *
+ *  The writer fills one slot while the reader reads another, and finished slots are swapped through the third with a
+ *  single atomic exchange. So the writer never drops anything because the reader is slow, and the reader always gets a
+ *  whole, consistent value (skipping to the newest one if it's fallen behind).
  */
-class SharedBuffer {
+template <typename T>
+class TripleBuffer {
     private:
-        AbstractFifo fifo;
-        std::vector<float> writeBuffer;
-        std::vector<float> readBuffer;
-        int size;
+        /** Set alongside the index in the middle slot when it holds a value the reader hasn't seen */
+        static constexpr int FRESH = 4;
+        static constexpr int INDEX_MASK = 3;
+
+        std::array<T, 3> slots;
+        std::atomic<int> middle { 1 };
+        // Writer only
+        int back = 0;
+        // Reader only
+        int front = 2;
+
     public:
-        SharedBuffer(int size): fifo(size), writeBuffer(size, 0.0f), readBuffer(size, 0.0f) {
+        explicit TripleBuffer(const T& initial): slots { initial, initial, initial } {}
 
+        /** Writer only. The slot to fill in, which may still hold an old value */
+        T& getBack() {
+            return slots[(size_t) back];
         }
 
-        /** Call this from the audio thread only */
-        void write(int count, const float * readPointer) {
-            int start1, size1, start2, size2;
-            fifo.prepareToWrite(count, start1, size1, start2, size2);
+        /** Writer only. Hands over the slot from getBack(), and gives it a different one */
+        void publish() {
+            back = middle.exchange(back | FRESH) & INDEX_MASK;
+        }
 
-            if (size1 > 0)
-                std::copy(readPointer, readPointer + size1, writeBuffer.begin() + start1);
-            if (size2 > 0)
-                std::copy(readPointer + size1, readPointer + size1 + size2, writeBuffer.begin() + start2);
+        /** Reader only. Swaps in the newest value, returns false if there isn't a new one */
+        bool update() {
+            if ((middle.load() & FRESH) == 0) {
+                return false;
+            }
+            front = middle.exchange(front) & INDEX_MASK;
+            return true;
+        }
 
-            fifo.finishedWrite(size1 + size2);
+        /** Reader only. The value from the last successful update() */
+        const T& getFront() const {
+            return slots[(size_t) front];
         }
+};
 
-        /** Call this from the GUI thread only */
-        const std::vector<float> & read() {
-            int start1, size1, start2, size2;
-            fifo.prepareToRead(512, start1, size1, start2, size2);
+/** The latest few hundred stereo frames from some point in the signal chain, for the editor to draw. The audio thread
+ *  never waits and never drops a frame because the editor is slow.
+ *
+ *  When triggered, each frame starts where the signal crosses zero on the way up, so a steady note stays still on
+ *  screen rather than jumping around with the block size. If no crossing turns up within a frame's length it starts
+ *  anyway.
+ *
+ *  Writing costs nothing more than checking a flag unless something is consuming it.
+ */
+class SharedBuffer {
+    private:
+        const int size;
+        const bool trigger;
+        TripleBuffer<AudioBuffer<float>> frames;
+        std::atomic<bool> active { false };
 
-            if (size1 > 0)
-                std::copy(writeBuffer.begin() + start1,
-                        writeBuffer.begin() + start1 + size1,
-                        readBuffer.begin());
-            if (size2 > 0)
-                std::copy(writeBuffer.begin() + start2,
-                        writeBuffer.begin() + start2 + size2,
-                        readBuffer.begin() + size1);
+        /** GUI thread only */
+        int consumers = 0;
 
-            fifo.finishedRead(size1 + size2);
+        // Audio thread only
+        int filled = 0;
+        bool capturing;
+        int waited = 0;
+        float previous = 0.0f;
 
-            return readBuffer;
+        void publish() {
+            frames.publish();
+            filled = 0;
+            capturing = ! trigger;
         }
 
-        /** Call this from the GUI thread only */
-        const std::vector<float> & get() const {
-            return readBuffer;
+        static AudioBuffer<float> silence(int size) {
+            AudioBuffer<float> frame(2, size);
+            frame.clear();
+            return frame;
         }
 
-};
+    public:
+        SharedBuffer(int size, bool trigger = true)
+            : size(size), trigger(trigger), frames(silence(size)), capturing(! trigger) {
+        }
+
+        /** Call this from the audio thread only. A mono buffer goes into both channels */
+        void write(const AudioBuffer<float>& audio) {
+            if (! active.load(std::memory_order_relaxed)) {
+                // Start afresh when someone's watching again, rather than finishing a frame from before
+                filled = 0;
+                capturing = ! trigger;
+                return;
+            }
+            auto numSamples = audio.getNumSamples();
+            auto* left = audio.getReadPointer(0);
+            auto* right = audio.getReadPointer(jmin(1, audio.getNumChannels() - 1));
 
+            int i = 0;
+            while (i < numSamples) {
+                if (! capturing) {
+                    for (; i < numSamples; i++) {
+                        auto mid = left[i] + right[i];
+                        auto crossed = previous < 0.0f && mid >= 0.0f;
+                        previous = mid;
+                        if (crossed || ++waited >= size) {
+                            capturing = true;
+                            waited = 0;
+                            break;
+                        }
+                    }
+                    if (! capturing) {
+                        return;
+                    }
+                }
+
+                auto n = jmin(numSamples - i, size - filled);
+                frames.getBack().copyFrom(0, filled, left + i, n);
+                frames.getBack().copyFrom(1, filled, right + i, n);
+                filled += n;
+                i += n;
+                previous = left[i - 1] + right[i - 1];
+                if (filled == size) {
+                    publish();
+                }
+            }
+        }
+
+        /** Call this from the GUI thread only. Frames are only captured from the first addConsumer() to the last
+         *  matching removeConsumer() */
+        void addConsumer() {
+            if (consumers++ == 0) {
+                active = true;
+            }
+        }
+
+        void removeConsumer() {
+            if (--consumers == 0) {
+                active = false;
+            }
+        }
+
+        /** Call this from the GUI thread only. Swaps in the newest frame, returns false if there isn't a new one */
+        bool read() {
+            return frames.update();
+        }
+
+        /** Call this from the GUI thread only. The frame from the last successful read, two channels of getSize() */
+        const AudioBuffer<float> & get() const {
+            return frames.getFront();
+        }
+
+        int getSize() const {
+            return size;
+        }
+};
@@ -0,0 +1,94 @@
+/*
+    Copyright 2025 David Whiting
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <JuceHeader.h>
+
+/*  Read-only data which would be the same in every instance of the plugin. Each of these is held through a
+    SharedResourcePointer, so there's one copy in the process however many instances there are; it's built when the
+    first user appears and freed when the last one goes. The DSP's share is in SineTable.hpp, so that it doesn't pull
+    the editor's BinaryData into anything that only renders audio. */
+
+/** Everything the editor draws with that comes from BinaryData. Message thread only, and each item is only decoded the
+ *  first time it's asked for */
+class EditorResources {
+    private:
+    /** Enough for a few editors open at different sizes or on different screens without them pushing each other out */
+    static constexpr size_t MAX_SCALED_BACKGROUNDS = 4;
+
+    struct ScaledBackground {
+        int width, height;
+        float scale;
+        Image image;
+    };
+
+    Typeface::Ptr gothicaBook;
+    Image keyboardIcon;
+    Image background;
+
+    /** The background scaled and cropped for each size it's been drawn at lately, most recently used first */
+    std::vector<ScaledBackground> scaledBackgrounds;
+
+    public:
+    Font getGothicaBook() {
+        if (gothicaBook == nullptr) {
+            gothicaBook = Typeface::createSystemTypefaceFor(BinaryData::GothicaBook_ttf, BinaryData::GothicaBook_ttfSize);
+        }
+        return Font(gothicaBook);
+    }
+
+    Typeface::Ptr getGothicaBookTypeface() {
+        getGothicaBook();
+        return gothicaBook;
+    }
+
+    Image getKeyboardIcon() {
+        if (! keyboardIcon.isValid()) {
+            keyboardIcon = ImageFileFormat::loadFrom(BinaryData::keyboardicon_png, BinaryData::keyboardicon_pngSize);
+        }
+        return keyboardIcon;
+    }
+
+    /** The background image filling width x height (cropping rather than stretching), at scale physical pixels per
+     *  logical pixel. Drawn into width x height logical pixels it's then a straight copy, since scaling it is by far
+     *  the most expensive part of drawing the editor. It's only scaled again for a size or scale it hasn't seen lately */
+    Image getBackground(int width, int height, float scale) {
+        for (auto it = scaledBackgrounds.begin(); it != scaledBackgrounds.end(); ++it) {
+            if (it->width == width && it->height == height && it->scale == scale) {
+                std::rotate(scaledBackgrounds.begin(), it, it + 1);
+                return scaledBackgrounds.front().image;
+            }
+        }
+        if (! background.isValid()) {
+            background = ImageFileFormat::loadFrom(BinaryData::bg_jpg, BinaryData::bg_jpgSize);
+        }
+
+        auto physicalWidth = jmax(1, roundToInt((float) width * scale));
+        auto physicalHeight = jmax(1, roundToInt((float) height * scale));
+        Image scaled(Image::RGB, physicalWidth, physicalHeight, false);
+        {
+            Graphics g(scaled);
+            g.setImageResamplingQuality(Graphics::highResamplingQuality);
+            g.drawImageWithin(background, 0, 0, physicalWidth, physicalHeight, RectanglePlacement::fillDestination);
+        }
+
+        scaledBackgrounds.insert(scaledBackgrounds.begin(), { width, height, scale, scaled });
+        if (scaledBackgrounds.size() > MAX_SCALED_BACKGROUNDS) {
+            scaledBackgrounds.pop_back();
+        }
+        return scaled;
+    }
+};
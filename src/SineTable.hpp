@@ -0,0 +1,43 @@
+/*
+    Copyright 2025 David Whiting
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <JuceHeader.h>
+
+/** One cycle of a sine, for the LFOs. Held through a SharedResourcePointer, so it's built once per process rather than
+ *  once per voice */
+class SineTable {
+    public:
+    static constexpr int SIZE = 512;
+
+    SineTable() {
+        for (int i = 0; i <= SIZE; i++) {
+            values[i] = std::sin(MathConstants<float>::twoPi * (float) i / SIZE);
+        }
+    }
+
+    /** phase goes from 0 to 1 over the cycle; linearly interpolated between entries */
+    float lookup(float phase) const {
+        auto position = phase * SIZE;
+        auto index = jlimit(0, SIZE - 1, (int) position);
+        auto fraction = position - (float) index;
+        return values[index] + fraction * (values[index + 1] - values[index]);
+    }
+
+    private:
+    /** One extra entry on the end, so interpolating from the last one doesn't need to wrap */
+    float values[SIZE + 1];
+};
@@ -0,0 +1,194 @@
+/*
+    Copyright 2025 David Whiting
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <JuceHeader.h>
+#include "SharedBuffer.hpp"
+
+/** Spectrum of the voices, for the editor.
+ *
+ *  All the audio thread does is copy each block into a FIFO, and only while something is watching. A worker thread
+ *  takes overlapping Hann-windowed frames from the FIFO, runs the FFTs, and smooths the result into a level and a
+ *  held peak for each bin, which are handed to the editor through a TripleBuffer. The worker only exists while there's
+ *  at least one consumer, so with the editor closed none of this costs anything.
+ */
+class SpectrumAnalyser: private Thread {
+    public:
+    static constexpr int ORDER = 11;
+    static constexpr int SIZE = 1 << ORDER;
+    static constexpr int NUM_BINS = SIZE / 2;
+    static constexpr float FLOOR_DB = -100.0f;
+
+    struct Frame {
+        /** Smoothed level of each bin, in dB */
+        std::vector<float> levels;
+        /** Highest recent level of each bin, in dB */
+        std::vector<float> peaks;
+        double sampleRate;
+    };
+
+    private:
+    /** Four windows per frame, so there's a new frame every 10ms or so */
+    static constexpr int HOP = SIZE / 4;
+    static constexpr int FIFO_SIZE = SIZE * 4;
+
+    /** How much of the new level each bin takes when it's falling; rises are immediate */
+    static constexpr float RELEASE = 0.25f;
+    static constexpr int PEAK_HOLD_HOPS = 40;
+    static constexpr float PEAK_FALL_DB = 0.5f;
+
+    AbstractFifo fifo { FIFO_SIZE };
+    AudioBuffer<float> fifoBuffer { 2, FIFO_SIZE };
+    std::atomic<bool> active { false };
+    std::atomic<double> sampleRate { 44100.0 };
+
+    TripleBuffer<Frame> frames;
+
+    /** Message thread only */
+    int consumers = 0;
+
+    // Worker only
+    dsp::FFT fft { ORDER };
+    dsp::WindowingFunction<float> window { (size_t) SIZE, dsp::WindowingFunction<float>::hann, false };
+    std::vector<float> history = std::vector<float>((size_t) SIZE);
+    std::vector<float> fftData = std::vector<float>((size_t) SIZE * 2);
+    std::vector<float> levels = std::vector<float>((size_t) NUM_BINS);
+    std::vector<float> peaks = std::vector<float>((size_t) NUM_BINS);
+    std::vector<int> peakAges = std::vector<int>((size_t) NUM_BINS);
+
+    /** Moves the next HOP samples from the FIFO onto the end of the history, as mono */
+    void readHop() {
+        std::move(history.begin() + HOP, history.end(), history.begin());
+        auto* destination = history.data() + SIZE - HOP;
+
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(HOP, start1, size1, start2, size2);
+        auto mix = [this, destination] (int start, int size, int offset) {
+            auto* left = fifoBuffer.getReadPointer(0, start);
+            auto* right = fifoBuffer.getReadPointer(1, start);
+            for (int i = 0; i < size; i++) {
+                destination[offset + i] = 0.5f * (left[i] + right[i]);
+            }
+        };
+        mix(start1, size1, 0);
+        mix(start2, size2, size1);
+        fifo.finishedRead(size1 + size2);
+    }
+
+    void analyse() {
+        std::copy(history.begin(), history.end(), fftData.begin());
+        window.multiplyWithWindowingTable(fftData.data(), (size_t) SIZE);
+        fft.performFrequencyOnlyForwardTransform(fftData.data());
+
+        // A full scale sine comes out at 0dB; the Hann window halves the amplitude
+        constexpr float scale = 4.0f / SIZE;
+        for (size_t i = 0; i < (size_t) NUM_BINS; i++) {
+            auto level = Decibels::gainToDecibels(fftData[i] * scale, FLOOR_DB);
+            levels[i] = level > levels[i] ? level : levels[i] + (level - levels[i]) * RELEASE;
+            if (level >= peaks[i]) {
+                peaks[i] = level;
+                peakAges[i] = 0;
+            } else if (++peakAges[i] > PEAK_HOLD_HOPS) {
+                peaks[i] = jmax(FLOOR_DB, peaks[i] - PEAK_FALL_DB);
+            }
+        }
+
+        auto& frame = frames.getBack();
+        std::copy(levels.begin(), levels.end(), frame.levels.begin());
+        std::copy(peaks.begin(), peaks.end(), frame.peaks.begin());
+        frame.sampleRate = sampleRate.load();
+        frames.publish();
+    }
+
+    void run() override {
+        // Whatever's left over from the last time anyone was watching is stale
+        fifo.finishedRead(fifo.getNumReady());
+        std::fill(history.begin(), history.end(), 0.0f);
+        std::fill(levels.begin(), levels.end(), FLOOR_DB);
+        std::fill(peaks.begin(), peaks.end(), FLOOR_DB);
+
+        while (! threadShouldExit()) {
+            // If it's fallen a long way behind, skip ahead rather than show old news
+            auto backlog = fifo.getNumReady() - SIZE;
+            if (backlog > 0) {
+                fifo.finishedRead(backlog - backlog % HOP);
+            }
+            if (fifo.getNumReady() < HOP) {
+                wait(5);
+                continue;
+            }
+            readHop();
+            analyse();
+        }
+    }
+
+    public:
+    SpectrumAnalyser()
+        : Thread("Crypt spectrum analyser"),
+          frames({ std::vector<float>((size_t) NUM_BINS, FLOOR_DB), std::vector<float>((size_t) NUM_BINS, FLOOR_DB), 44100.0 }) {
+    }
+
+    ~SpectrumAnalyser() override {
+        stopThread(1000);
+    }
+
+    void prepare(double newSampleRate) {
+        sampleRate = newSampleRate;
+    }
+
+    /** Audio thread only. Does nothing unless someone's watching, and drops what doesn't fit if the worker is behind */
+    void write(const AudioBuffer<float>& audio) {
+        if (! active.load(std::memory_order_relaxed)) {
+            return;
+        }
+        auto right = jmin(1, audio.getNumChannels() - 1);
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(audio.getNumSamples(), start1, size1, start2, size2);
+        if (size1 > 0) {
+            fifoBuffer.copyFrom(0, start1, audio, 0, 0, size1);
+            fifoBuffer.copyFrom(1, start1, audio, right, 0, size1);
+        }
+        if (size2 > 0) {
+            fifoBuffer.copyFrom(0, start2, audio, 0, size1, size2);
+            fifoBuffer.copyFrom(1, start2, audio, right, size1, size2);
+        }
+        fifo.finishedWrite(size1 + size2);
+    }
+
+    /** Message thread only. The analysis runs from the first addConsumer() to the last matching removeConsumer() */
+    void addConsumer() {
+        if (consumers++ == 0) {
+            active = true;
+            startThread();
+        }
+    }
+
+    void removeConsumer() {
+        if (--consumers == 0) {
+            active = false;
+            stopThread(1000);
+        }
+    }
+
+    /** Only for the one consumer that draws it. Swaps in the newest result, returns false if there isn't a new one */
+    bool read() {
+        return frames.update();
+    }
+
+    const Frame& get() const {
+        return frames.getFront();
+    }
+};
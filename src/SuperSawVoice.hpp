@@ -19,6 +19,8 @@
 #include "CryptParameters.hpp"
 #include "CustomParameterModel.hpp"
 #include "ParameterControlledADSR.hpp"
+#include "ParameterControlledLFO.hpp"
+#include "DspKernels.hpp"
 
 #define TAU MathConstants<float>::twoPi
 
@@ -27,19 +29,21 @@
  */
 class SuperSawVoice : public SynthesiserVoice, public AudioProcessorValueTreeState::Listener {
 private:
-    /** Stores the state of a single oscillator (of many) within the Voice */
-    struct OscState {
-        float angle = 0.0;
-        float frequency = 440;
-        float increment = 0.0;
-        float pan = 0.0;
-        float spreadRnd = 0.0;
+    static constexpr int MAX_UNISON = 64;
+
+    /** The state of every oscillator within the voice, one array per field, so that updating them all at once
+     *  (eg. when the spread is modulated) is a single vectorisable loop */
+    struct Oscillators {
+        float angle[MAX_UNISON] = {};
+        float increment[MAX_UNISON] = {};
+        float pan[MAX_UNISON] = {};
+        /** Fixed random pitch offset of each oscillator, -0.5 to 0.5, which gets scaled by the spread */
+        float detune[MAX_UNISON] = {};
     };
 
     /** The set of oscillators which make up this voice */
-    std::vector<OscState> oscillators;
+    Oscillators oscillators;
 
-    int maxUnisonOscs = 64;
     int activeUnisonOscs = 32;
 
     /** Multiplier for output signal (used to scale by velocity) */
@@ -47,6 +51,12 @@ private:
 
     float mainFrequency = 440;
 
+    /** Phase increment per sample of the undetuned note */
+    float baseIncrement = 0.0f;
+
+    /** The (possibly modulated) spread the oscillator increments were last worked out with */
+    float appliedSpread = 0.03f;
+
     float pitchBend = 0.0;
 
     int pitchBendRange = 2;
@@ -60,14 +70,16 @@ private:
     float filterEnv = 0.0f;
     float spread = 0.03f;
 
+    /** Spread, shape and dirt as the voice is playing them. They follow the parameters over about 20ms, since preset
+     *  changes and the morph set them once per block, which would otherwise be heard as steps */
+    float rampedSpread = 0.03f;
+    float rampedShape = 0.0f;
+    float rampedDirt = 0.0f;
+    float rampCoefficient = 1.0f;
+
     /** Reference to the parameter tree for the entire plugin so we can access parameters */
     AudioProcessorValueTreeState& state;
 
-    /** Un-antialiased sawtooth function between 0 and TAU */
-    static inline float saw(float angle) {
-        return (2.0f * angle/TAU) - 1;
-    }
-
     static inline float square(float angle) {
         return std::copysign(1.0f, angle - MathConstants<float>::pi);
     }
@@ -75,44 +87,27 @@ private:
     ParameterControlledADSR ampEnvelope { CryptParameters::Amplitude };
     ParameterControlledADSR filterEnvelope { CryptParameters::Filter };
 
-    dsp::StateVariableTPTFilter<float> filter;
-
-    /** Waveshaping function which applies a cubic clipping curve, gained by the 'dirt' parameter */
-    inline float shapeCompoundWave(float f, float dirt) {
-        constexpr float factor = 2.0f;
-        f = f * (1.0f/factor + dirt*10.0f);
-        if (f < -1.0f) {
-            return factor * -2/3.0f;
-        } else if (f > 1.0f) {
-            return factor * 2/3.0f;
-        } else {
-            return factor * (f - (f * f * f)/3.0f);
-        }
-    }
-
-    static constexpr int SINE_WAVETABLE_SIZE = 512;
-    float sinTable[SINE_WAVETABLE_SIZE];
+    ParameterControlledLFO lfo { CryptParameters::VoiceLfo, 2.0f };
+    const GlobalModulation& globalModulation;
 
-    void fillWaveTable() {
-        for (auto i = 0; i < SINE_WAVETABLE_SIZE; i++) {
-            float angle = TAU * i / SINE_WAVETABLE_SIZE;
-            sinTable[i] = sin(angle);
-        }
-    }
+    /** State of the TPT state variable lowpass (s1, s2 for left then right), which runs in DspKernels */
+    float filterState[4] = {};
 
-    float wtSin(float angle) {
-        jassert(angle >= 0.0f);
+    /** The filter coefficient is worked out once per control period and ramped across it */
+    float filterG = 0.0f;
+    bool filterGValid = false;
 
-        return sinTable[static_cast<int>(SINE_WAVETABLE_SIZE * angle / TAU) % SINE_WAVETABLE_SIZE];
-    }
+    /** Voices render in short chunks, one per modulation control period, so that all the intermediate signals fit in
+     *  small arrays on the stack */
+    static constexpr int RENDER_CHUNK = GlobalModulation::CONTROL_INTERVAL;
 
     void parameterChanged(const String &parameterID, float newValue) override {
         if (parameterID == CryptParameters::Spread) {
+            // Picked up (along with any modulation) at the start of the next control period
             spread = newValue;
-            setFrequency(mainFrequency, spread, false);
         } else if (parameterID == CryptParameters::Unison) {
             activeUnisonOscs = static_cast<int>(newValue);
-            setFrequency(mainFrequency, spread, true);
+            setFrequency(mainFrequency, true);
         } else if (parameterID == CryptParameters::Shape) {
             shape = newValue;
         } else if (parameterID == CryptParameters::Dirt) {
@@ -128,7 +123,14 @@ private:
         }
     }
 
-    
+    /** Work out every oscillator's increment from the note and a new spread; one multiply-add per oscillator */
+    void applySpread(float newSpread) {
+        appliedSpread = newSpread;
+        auto spreadIncrement = baseIncrement * newSpread;
+        for (int i = 0; i < MAX_UNISON; i++) {
+            oscillators.increment[i] = baseIncrement + spreadIncrement * oscillators.detune[i];
+        }
+    }
 
 public:
 
@@ -146,12 +148,15 @@ public:
         return params;
     }
 
+    static std::vector<ParameterSpec> lfoParams() {
+        return ParameterControlledLFO::params(CryptParameters::VoiceLfo, 2.0f);
+    }
+
     void registerParams(AudioProcessorValueTreeState& state) {
-        for (auto p: params()) {
-            state.addParameterListener(p.id, this);
-        }
+        listenToParams(state, params(), this);
         ampEnvelope.registerParams(state);
         filterEnvelope.registerParams(state);
+        lfo.registerParams(state);
     }
 
     void unRegisterParams(AudioProcessorValueTreeState& state) {
@@ -160,38 +165,34 @@ public:
         }
         ampEnvelope.unRegisterParams(state);
         filterEnvelope.unRegisterParams(state);
+        lfo.unRegisterParams(state);
     }
 
-    explicit SuperSawVoice(AudioProcessorValueTreeState& state): state(state) {
-        for (int i = 0; i < maxUnisonOscs; i++) {
-            oscillators.emplace_back();
-        }
-        fillWaveTable();
+    SuperSawVoice(AudioProcessorValueTreeState& state, const GlobalModulation& globalModulation)
+            : state(state), globalModulation(globalModulation) {
         registerParams(state);
-        // We need to prepare with something before we hit a note, because we may hit renderBlock before startNote
-        filter.prepare({ .sampleRate = 44100, .maximumBlockSize = 8192, .numChannels = 2 });
     }
 
     /**
      * Whenever we change the frequency, we need to apply the variations across all oscillators
      * @param freq Base frequency (ie. note frequency)
-     * @param spread How much random deviation from the freq to apply to each oscillator
      * @param resetAngles Whether osc angles should be reset to initial positions (yes when starting new note, no when
      *                    continuing existing note
      */
-    void setFrequency(float freq, float spread, bool phaseReset) {
+    void setFrequency(float freq, bool phaseReset) {
         mainFrequency = freq;
+        auto sampleRate = getSampleRate();
+        baseIncrement = sampleRate > 0.0 ? (float) (freq / sampleRate) * TAU : 0.0f;
+
         Random rnd;
         for (int i = 0; i < activeUnisonOscs; i++) {
             if (phaseReset) {
-                oscillators[i].angle = i / float(activeUnisonOscs) * TAU;
-                oscillators[i].spreadRnd = rnd.nextFloat();
+                oscillators.angle[i] = i / float(activeUnisonOscs) * TAU;
+                oscillators.detune[i] = rnd.nextFloat() - 0.5f;
             }
-            oscillators[i].frequency = freq * (1 + oscillators[i].spreadRnd * spread - spread / 2);
-            oscillators[i].pan = i / float(activeUnisonOscs - 1) * 2 - 1;
-            float cyclesPerSample = oscillators[i].frequency / getSampleRate();
-            oscillators[i].increment = cyclesPerSample * TAU;
+            oscillators.pan[i] = i / float(activeUnisonOscs - 1) * 2 - 1;
         }
+        applySpread(appliedSpread);
     }
 
     float calcFrequency(int midiNoteNumber, int pitchWheelValue) {
@@ -207,20 +208,33 @@ public:
         ampEnvelope.setSampleRate(getSampleRate());
         filterEnvelope.reset();
         filterEnvelope.setSampleRate(getSampleRate());
+        lfo.retrigger();
     
         midiNote = midiNoteNumber;
-        setFrequency(calcFrequency(midiNoteNumber, currentPitchWheelPosition), spread, true);
+        rampedSpread = spread;
+        rampedShape = shape;
+        rampedDirt = dirt;
+        rampCoefficient = 1.0f - std::exp(-(float) RENDER_CHUNK / (0.02f * (float) getSampleRate()));
+        appliedSpread = spread;
+        setFrequency(calcFrequency(midiNoteNumber, currentPitchWheelPosition), true);
 
-        filter.prepare({ .sampleRate = getSampleRate(), .maximumBlockSize = 8192, .numChannels = 2});
+        std::fill(std::begin(filterState), std::end(filterState), 0.0f);
+        filterGValid = false;
 
         level = velocity * 0.04f + 0.02f;
         ampEnvelope.noteOn();
         filterEnvelope.noteOn();
     }
 
+    /** Bending moves every oscillator by the same ratio, so there's no need to work the spread out again */
     void pitchWheelMoved (int newPitchWheelValue) override {
-        
-        setFrequency(calcFrequency(midiNote, newPitchWheelValue), spread, false);
+        auto newFrequency = calcFrequency(midiNote, newPitchWheelValue);
+        auto ratio = newFrequency / mainFrequency;
+        mainFrequency = newFrequency;
+        baseIncrement *= ratio;
+        for (int i = 0; i < MAX_UNISON; i++) {
+            oscillators.increment[i] *= ratio;
+        }
     }
 
     void stopNote(float velocity, bool allowTailOff) override {
@@ -247,40 +261,83 @@ public:
         // pleasing response curve to it.
         float unisonScaleFactor = 3.0f / sqrt(4.0f + (float)activeUnisonOscs);
 
-        filter.setCutoffFrequency(cutoff);
-        filter.setResonance(resonance);
-
         // Save CPU if the voice is not currently playing
         if (!ampEnvelope.isActive()) {
             clearCurrentNote();
             return;
         }
 
-        for (auto sample = startSample; sample < startSample + numSamples; ++sample) {
-            auto outL = 0.0f;
-            auto outR = 0.0f;
-            auto envelopeValue = ampEnvelope.getNextSample();
-            auto filterEnvValue = filterEnvelope.getNextSample();
+        auto& kernels = DspKernels::get();
+        auto sampleRate = (float) getSampleRate();
+        auto maxCutoff = jmin(20000.0f, sampleRate * 0.49f);
+        auto R2 = 1.0f / resonance;
+        auto& voiceAmounts = lfo.getAmounts();
+        auto& globalAmounts = globalModulation.getAmounts();
+
+        float oscL[RENDER_CHUNK], oscR[RENDER_CHUNK], gain[RENDER_CHUNK], g[RENDER_CHUNK];
+
+        for (auto chunkStart = startSample; chunkStart < startSample + numSamples; chunkStart += RENDER_CHUNK) {
+            auto n = jmin(RENDER_CHUNK, startSample + numSamples - chunkStart);
+
+            // Control rate: evaluate the modulation once for the whole chunk
+            auto voiceLfo = lfo.tick(n, sampleRate);
+            auto globalLfo = globalModulation.getValueAt(chunkStart);
+            auto modulate = [&](float ModulationAmounts::* target) {
+                return voiceAmounts.*target * voiceLfo + globalAmounts.*target * globalLfo;
+            };
+
+            // Snaps once it's close, so a settled spread doesn't mean working the increments out again every chunk
+            auto ramp = [this](float& value, float target) {
+                value = std::abs(target - value) < 1.0e-5f ? target : value + (target - value) * rampCoefficient;
+            };
+            ramp(rampedSpread, spread);
+            ramp(rampedShape, shape);
+            ramp(rampedDirt, dirt);
+
+            auto modSpread = jlimit(0.0f, 0.2f, rampedSpread + modulate(&ModulationAmounts::spread));
+            if (modSpread != appliedSpread) {
+                applySpread(modSpread);
+            }
+            auto modShape = jlimit(0.0f, 1.0f, rampedShape + modulate(&ModulationAmounts::shape));
+            auto modDirt = jlimit(0.0f, 1.0f, rampedDirt + modulate(&ModulationAmounts::dirt));
+            auto width = jlimit(0.0f, 1.0f, 1.0f - voiceAmounts.width * (voiceLfo + 1.0f) / 2.0f
+                                                 - globalAmounts.width * (globalLfo + 1.0f) / 2.0f);
 
+            std::fill(oscL, oscL + n, 0.0f);
+            std::fill(oscR, oscR + n, 0.0f);
             for (int i = 0; i < activeUnisonOscs; i++) {
-                auto &o = oscillators[i];
-                float rPan = (o.pan + 1) / 2;
+                float rPan = (oscillators.pan[i] * width + 1) / 2;
                 float lPan = 1.0f - rPan;
+                oscillators.angle[i] = kernels.unisonSaw(oscL, oscR, n, oscillators.angle[i], oscillators.increment[i],
+                                                         unisonScaleFactor * lPan, unisonScaleFactor * rPan, modShape);
+            }
 
-                float wave = saw(o.angle);
-                float shaped = std::clamp(float(wave + copysign(shape, wave)), -1.0f, 1.0f);
+            float filterEnvValue = 0.0f;
+            for (int i = 0; i < n; i++) {
+                gain[i] = level * ampEnvelope.getNextSample();
+                filterEnvValue = filterEnvelope.getNextSample();
+            }
 
-                outL += unisonScaleFactor * shaped * lPan;
-                outR += unisonScaleFactor * shaped * rPan;
-                o.angle += o.increment;
-                if (o.angle > TAU) o.angle -= TAU;
+            float cutoffWithEnv = cutoff * exp2(filterEnv * 4.0f * filterEnvValue + modulate(&ModulationAmounts::cutoff));
+            auto targetG = std::tan(MathConstants<float>::pi * jlimit(10.0f, maxCutoff, cutoffWithEnv) / sampleRate);
+            if (!filterGValid) {
+                filterG = targetG;
+                filterGValid = true;
+            }
+            for (int i = 0; i < n; i++) {
+                g[i] = filterG + (targetG - filterG) * (float) (i + 1) / (float) n;
             }
+            filterG = targetG;
 
-            float cutoffWithEnv = cutoff * pow(2.0f, (filterEnv * 4.0f * filterEnvValue));
-            filter.setCutoffFrequency(cutoffWithEnv > 20000.0f ? 20000.0f : cutoffWithEnv);
-            
-            left[sample] += shapeCompoundWave(filter.processSample(0, outL), dirt) * level * envelopeValue;
-            right[sample] += shapeCompoundWave(filter.processSample(1, outR), dirt) * level * envelopeValue;
+            kernels.svfLowpassStereo(oscL, oscR, n, g, R2, filterState);
+            kernels.shapeAndMix(left + chunkStart, right + chunkStart, oscL, oscR, gain, n, modDirt);
+        }
+
+        // A NaN in the filter state would otherwise stick around for the rest of the note, so kill the voice instead
+        if (! std::isfinite(filterState[0] + filterState[1] + filterState[2] + filterState[3])) {
+            std::fill(std::begin(filterState), std::end(filterState), 0.0f);
+            ampEnvelope.reset();
+            filterEnvelope.reset();
         }
 
         if (!ampEnvelope.isActive()) {
@@ -288,4 +345,4 @@ public:
         }
 
     }
-};
+};
\ No newline at end of file
@@ -0,0 +1,174 @@
+/*
+    Copyright 2025 David Whiting
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*  Numerical soak test: renders hours of random notes and parameter automation through the plugin as fast as it'll
+    go, and reports how long each block took against its real-time budget, so that slow creep (eg. denormals building
+    up in a tail) or spikes show up, along with any numerical faults the processor caught and contained.
+
+        CryptSoakTest [hours=1] [seed=1] [sampleRate=48000] [blockSize=512]
+
+    Prints one line per minute of rendered audio, and exits with 1 if any faults were caught or anything non-finite
+    made it to the output. */
+
+#include <JuceHeader.h>
+#include "CryptAudioProcessor.hpp"
+
+// The soak test never opens an editor
+juce::AudioProcessorEditor* CryptAudioProcessor::createEditor() {
+    return nullptr;
+}
+
+namespace {
+    struct BlockStats {
+        std::vector<double> loads;
+        double total = 0.0;
+
+        void add(double load) {
+            loads.push_back(load);
+            total += load;
+        }
+
+        double mean() const { return loads.empty() ? 0.0 : total / (double) loads.size(); }
+
+        double percentile(double p) {
+            if (loads.empty()) {
+                return 0.0;
+            }
+            auto n = (size_t) ((double) (loads.size() - 1) * p);
+            std::nth_element(loads.begin(), loads.begin() + (ptrdiff_t) n, loads.end());
+            return loads[n];
+        }
+
+        double max() const { return loads.empty() ? 0.0 : *std::max_element(loads.begin(), loads.end()); }
+
+        void clear() {
+            loads.clear();
+            total = 0.0;
+        }
+    };
+
+    /** Moves a random parameter somewhere random, except the ones that only matter offline */
+    void automateRandomParameter(CryptAudioProcessor& processor, Random& random) {
+        auto& parameters = processor.getParameters();
+        auto* parameter = parameters[random.nextInt(parameters.size())];
+        if (auto* ranged = dynamic_cast<RangedAudioParameter*>(parameter)) {
+            if (ranged->paramID == CryptParameters::OfflineQuality) {
+                return;
+            }
+        }
+        parameter->setValueNotifyingHost(random.nextFloat());
+    }
+}
+
+int main(int argc, char* argv[]) {
+    ScopedJuceInitialiser_GUI juceInitialiser;
+
+    auto argument = [&](int index, double fallback) {
+        return argc > index ? String(argv[index]).getDoubleValue() : fallback;
+    };
+    auto hours = argument(1, 1.0);
+    auto seed = (int64) argument(2, 1.0);
+    auto sampleRate = argument(3, 48000.0);
+    auto blockSize = (int) argument(4, 512.0);
+
+    CryptAudioProcessor processor;
+    processor.setNonRealtime(false);
+    processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+    processor.prepareToPlay(sampleRate, blockSize);
+
+    Random random(seed);
+    AudioBuffer<float> audio(2, blockSize);
+    MidiBuffer midi;
+    std::array<bool, 128> held {};
+
+    auto budget = (double) blockSize / sampleRate;
+    auto blocksPerMinute = (int64) (60.0 * sampleRate / blockSize);
+    auto totalBlocks = (int64) (hours * 60.0) * blocksPerMinute;
+    BlockStats minute;
+    BlockStats overall;
+    int64 nonFiniteBlocks = 0;
+
+    std::cout << "Rendering " << hours << "h at " << sampleRate << "Hz in blocks of " << blockSize
+              << " (seed " << seed << ")" << std::endl;
+    std::cout << "minute  mean%  p99%   max%   faults  non-finite" << std::endl;
+
+    for (int64 block = 0; block < totalBlocks; block++) {
+        midi.clear();
+        // A few notes starting and stopping each second, and every two minutes a 15 second silence so that the
+        // tails get to decay all the way
+        auto silent = (block / (blocksPerMinute / 4)) % 8 == 7;
+        for (int note = 0; silent && note < 128; note++) {
+            if (held[(size_t) note]) {
+                midi.addEvent(MidiMessage::noteOff(1, note), 0);
+                held[(size_t) note] = false;
+            }
+        }
+        for (int i = 0; i < 2 && ! silent; i++) {
+            if (random.nextInt(20) != 0) {
+                continue;
+            }
+            auto note = 24 + random.nextInt(72);
+            auto position = random.nextInt(blockSize);
+            if (held[(size_t) note]) {
+                midi.addEvent(MidiMessage::noteOff(1, note), position);
+                held[(size_t) note] = false;
+            } else {
+                midi.addEvent(MidiMessage::noteOn(1, note, random.nextFloat()), position);
+                held[(size_t) note] = true;
+            }
+        }
+        if (random.nextInt(50) == 0) {
+            midi.addEvent(MidiMessage::pitchWheel(1, random.nextInt(16384)), random.nextInt(blockSize));
+        }
+        if (! silent && random.nextInt(10) == 0) {
+            automateRandomParameter(processor, random);
+        }
+
+        auto start = Time::getHighResolutionTicks();
+        processor.processBlock(audio, midi);
+        auto seconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+
+        for (int c = 0; c < audio.getNumChannels(); c++) {
+            auto range = FloatVectorOperations::findMinAndMax(audio.getReadPointer(c), blockSize);
+            if (! std::isfinite(range.getStart()) || ! std::isfinite(range.getEnd())) {
+                nonFiniteBlocks++;
+                break;
+            }
+        }
+
+        auto load = 100.0 * seconds / budget;
+        minute.add(load);
+        overall.add(load);
+
+        if ((block + 1) % blocksPerMinute == 0) {
+            std::cout << String((block + 1) / blocksPerMinute).paddedLeft(' ', 6)
+                      << String(minute.mean(), 2).paddedLeft(' ', 7)
+                      << String(minute.percentile(0.99), 2).paddedLeft(' ', 7)
+                      << String(minute.max(), 2).paddedLeft(' ', 7)
+                      << String(processor.getNumericalFaults()).paddedLeft(' ', 9)
+                      << String(nonFiniteBlocks).paddedLeft(' ', 12) << std::endl;
+            minute.clear();
+        }
+    }
+
+    std::cout << "Overall: mean " << String(overall.mean(), 2) << "%, p99 " << String(overall.percentile(0.99), 2)
+              << "%, p99.9 " << String(overall.percentile(0.999), 2) << "%, max " << String(overall.max(), 2)
+              << "% of real time; " << processor.getNumericalFaults() << " numerical faults contained, "
+              << nonFiniteBlocks << " non-finite blocks output" << std::endl;
+
+    return processor.getNumericalFaults() == 0 && nonFiniteBlocks == 0 ? 0 : 1;
+}
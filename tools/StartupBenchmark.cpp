@@ -0,0 +1,107 @@
+/*
+    Copyright 2025 David Whiting
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*  Startup benchmark: times what a host does with each instance when it scans the plugin (construct it, ask it some
+    questions, destroy it) and when it loads a session (construct, setStateInformation, prepareToPlay).
+
+        CryptStartupBenchmark [iterations=40] [sampleRate=48000] [blockSize=512]
+
+    Prints the mean, best and worst time of each step in milliseconds. */
+
+#include <JuceHeader.h>
+#include "CryptAudioProcessor.hpp"
+
+// The benchmark never opens an editor
+juce::AudioProcessorEditor* CryptAudioProcessor::createEditor() {
+    return nullptr;
+}
+
+namespace {
+    struct Timing {
+        String name;
+        StatisticsAccumulator<double> milliseconds;
+
+        void print() const {
+            std::cout << name.paddedRight(' ', 28)
+                      << String(milliseconds.getAverage(), 3).paddedLeft(' ', 9)
+                      << String(milliseconds.getMinValue(), 3).paddedLeft(' ', 9)
+                      << String(milliseconds.getMaxValue(), 3).paddedLeft(' ', 9) << std::endl;
+        }
+    };
+
+    template <typename Function>
+    void time(Timing& timing, Function&& function) {
+        auto start = Time::getHighResolutionTicks();
+        function();
+        timing.milliseconds.addValue(1000.0 * Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start));
+    }
+
+    /** A session state with every parameter away from its default, like a real project would have */
+    MemoryBlock createSessionState() {
+        CryptAudioProcessor source;
+        Random random(1);
+        for (auto* parameter: source.getParameters()) {
+            parameter->setValueNotifyingHost(random.nextFloat());
+        }
+        MemoryBlock state;
+        source.getStateInformation(state);
+        return state;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    ScopedJuceInitialiser_GUI juceInitialiser;
+
+    auto argument = [&](int index, double fallback) {
+        return argc > index ? String(argv[index]).getDoubleValue() : fallback;
+    };
+    auto iterations = (int) argument(1, 40.0);
+    auto sampleRate = argument(2, 48000.0);
+    auto blockSize = (int) argument(3, 512.0);
+
+    auto session = createSessionState();
+
+    Timing scan { "scan (construct + destroy)" };
+    Timing construct { "construct" };
+    Timing restore { "setStateInformation" };
+    Timing prepare { "prepareToPlay" };
+    Timing total { "session load total" };
+
+    for (int i = 0; i < iterations; i++) {
+        time(scan, [] {
+            CryptAudioProcessor processor;
+            ignoreUnused(processor.getName(), processor.getNumParameters(), processor.acceptsMidi());
+        });
+
+        auto start = Time::getHighResolutionTicks();
+        std::unique_ptr<CryptAudioProcessor> processor;
+        time(construct, [&] { processor = std::make_unique<CryptAudioProcessor>(); });
+        time(restore, [&] { processor->setStateInformation(session.getData(), (int) session.getSize()); });
+        time(prepare, [&] {
+            processor->setRateAndBufferSizeDetails(sampleRate, blockSize);
+            processor->prepareToPlay(sampleRate, blockSize);
+        });
+        total.milliseconds.addValue(1000.0 * Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start));
+    }
+
+    std::cout << iterations << " instances at " << sampleRate << "Hz, blocks of " << blockSize << std::endl;
+    std::cout << String("step").paddedRight(' ', 28) << "  mean ms   best ms  worst ms" << std::endl;
+    for (auto* timing: { &scan, &construct, &restore, &prepare, &total }) {
+        timing->print();
+    }
+    return 0;
+}